@@ -0,0 +1,60 @@
+import time
+import cpm
+import numpy as np
+
+# Compares the ways of accepting copies on a 2D tissue with integral
+# adhesion and area terms, where most energy deltas hit the table, with a
+# fractional perimeter term, where none do, and with act, which threshold
+# mode can often skip. All modes should show the same acceptance rate and
+# cell areas up to sampling noise.
+
+dimension = 256
+number_of_types = 2
+temperature = 10
+ticks = 100
+seeds = range(4)
+
+modes = [
+    ("exact, no table", dict(mode="exact", table_size=0)),
+    ("exact, table", dict(mode="exact")),
+    ("threshold", dict(mode="threshold")),
+]
+
+scenarios = [
+    ("integral", {}),
+    ("perimeter", dict(lambda_perimeter = 0.35, target_perimeter = 60)),
+    ("act", dict(lambda_act = 30, max_act = 20)),
+]
+
+def make_sim(seed, constraints):
+    sim = cpm.Cpm2d(dimension, number_of_types, temperature, seed=seed)
+    sim.set_constraints(cell_type = 1, lambda_area = 1, target_area = 200)
+    sim.set_constraints(cell_type = 1, other_cell_type = 1, adhesion = 10)
+    sim.set_constraints(cell_type = 0, other_cell_type = 1, adhesion = 4)
+    if constraints:
+        sim.set_constraints(cell_type = 1, **constraints)
+    for x in range(8, dimension, 16):
+        for y in range(8, dimension, 16):
+            sim.add_cell(1, x, y)
+    sim.run(20)
+    return sim
+
+for scenario, constraints in scenarios:
+    print(scenario)
+    for name, settings in modes:
+        elapsed = 0
+        rates = []
+        areas = []
+        for seed in seeds:
+            sim = make_sim(seed, constraints)
+            sim.set_acceptance(**settings)
+            start = time.time()
+            sim.run(ticks)
+            elapsed += time.time() - start
+            stats = sim.get_engine_stats()
+            rates.append(stats["accepted"] / stats["attempts"])
+            state = sim.get_state()
+            areas.append(np.mean(np.bincount(state.ravel())[1:]))
+        print("  {:16s} {:6.3f} s  acceptance {:.4f} +- {:.4f}  "
+                "area {:.1f} +- {:.1f}".format(name, elapsed, np.mean(rates),
+                    np.std(rates), np.mean(areas), np.std(areas)))
@@ -0,0 +1,142 @@
+// Compares the hashed DiceSet with the PagedDiceSet that backs the border
+// sets, on the borders of a 1024^2 and a 256^3 lattice. "tissue" holds the
+// faces of 16-voxel boxes tiling the whole lattice, "one cell" the surface
+// of a single ball of radius 32 in the middle, which touches few pages.
+// Elements are added and removed in random order, and draws pick uniform
+// positions as the engines do. Memory is what the set holds on the heap
+// once full. Build and run from the repository root with
+//     g++ -std=c++17 -O2 -Isrc examples/benchmark_dice_sets.cpp src/dice_set.cpp src/paged_dice_set.cpp && ./a.out
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+#include "dice_set.h"
+#include "paged_dice_set.h"
+
+using namespace std;
+
+// Counts the bytes currently allocated through operator new.
+static size_t allocated = 0;
+
+void* operator new(size_t size) {
+    auto block = (size_t*)malloc(size + 16);
+    if (!block)
+        throw bad_alloc();
+    *block = size;
+    allocated += size;
+    return (char*)block + 16;
+}
+
+void operator delete(void* pointer) noexcept {
+    if (!pointer)
+        return;
+    auto block = (size_t*)((char*)pointer - 16);
+    allocated -= *block;
+    free(block);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    operator delete(pointer);
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete[](void* pointer) noexcept {
+    operator delete(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    operator delete(pointer);
+}
+
+static const int draws = 10000000;
+
+static double nanosecondsPer(chrono::steady_clock::time_point start,
+        size_t count) {
+    auto elapsed = chrono::steady_clock::now() - start;
+    return chrono::duration<double, nano>(elapsed).count() / count;
+}
+
+template <typename Set, typename Make>
+void measure(const char* name, Make make, const vector<int>& elements) {
+    mt19937 rng(1);
+    vector<int> order = elements;
+    shuffle(order.begin(), order.end(), rng);
+
+    size_t before = allocated;
+    auto set = make();
+    auto start = chrono::steady_clock::now();
+    for (int element: order)
+        set->add(element);
+    double add = nanosecondsPer(start, order.size());
+    double megabytes = (allocated - before) / 1e6;
+
+    long checksum = 0;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < draws; i++)
+        checksum += set->get(rng() % set->size());
+    double draw = nanosecondsPer(start, draws);
+
+    shuffle(order.begin(), order.end(), rng);
+    start = chrono::steady_clock::now();
+    for (int element: order)
+        set->remove(element);
+    double remove = nanosecondsPer(start, order.size());
+
+    printf("    %-6s %8.1f MB  add %6.1f ns  remove %6.1f ns  "
+            "draw %5.1f ns  (%ld)\n", name, megabytes, add, remove, draw,
+            checksum % 10);
+}
+
+static void compare(const char* name, int capacity,
+        const vector<int>& elements) {
+    printf("  %s, %zu of %d indices\n", name, elements.size(), capacity);
+    measure<DiceSet>("hash", [] { return make_unique<DiceSet>(); },
+            elements);
+    measure<PagedDiceSet>("paged",
+            [=] { return make_unique<PagedDiceSet>(capacity); }, elements);
+}
+
+int main() {
+    const int side2 = 1024;
+    vector<int> tissue, ball;
+    for (int x = 0; x < side2; x++) {
+        for (int y = 0; y < side2; y++) {
+            int dx = x - side2/2, dy = y - side2/2;
+            int r2 = dx*dx + dy*dy;
+            if (x % 16 == 0 || y % 16 == 0)
+                tissue.push_back(x * side2 + y);
+            if (r2 <= 32*32 && r2 > 31*31)
+                ball.push_back(x * side2 + y);
+        }
+    }
+    printf("2D %d^2\n", side2);
+    compare("tissue", side2 * side2, tissue);
+    compare("one cell", side2 * side2, ball);
+
+    const int side3 = 256;
+    tissue.clear();
+    ball.clear();
+    for (int x = 0; x < side3; x++) {
+        for (int y = 0; y < side3; y++) {
+            for (int z = 0; z < side3; z++) {
+                int dx = x - side3/2, dy = y - side3/2, dz = z - side3/2;
+                int r2 = dx*dx + dy*dy + dz*dz;
+                int index = (x * side3 + y) * side3 + z;
+                if (x % 16 == 0 || y % 16 == 0 || z % 16 == 0)
+                    tissue.push_back(index);
+                if (r2 <= 32*32 && r2 > 31*31)
+                    ball.push_back(index);
+            }
+        }
+    }
+    printf("3D %d^3\n", side3);
+    compare("tissue", side3 * side3 * side3, tissue);
+    compare("one cell", side3 * side3 * side3, ball);
+    return 0;
+}
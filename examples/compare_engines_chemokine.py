@@ -0,0 +1,50 @@
+import cpm
+import numpy as np
+
+# Compares the rejection-free engine with the serial one while a chemokine
+# is solved during the run. A fixed strip on the left secretes it, and a
+# sheet of cells held together by a high cost of contact with medium is
+# drawn towards the strip against that cost. At this temperature almost no
+# copy happens without chemotaxis, so the rejection-free engine only
+# follows the sheet if it rebuilds its rates after every field update.
+# Both engines should show the same front and area up to sampling noise.
+
+dimension = 96
+temperature = 1
+ticks = 200
+seeds = range(8)
+
+def make_sim(seed):
+    sim = cpm.Cpm2d(dimension, 3, temperature, boundary="wall", seed=seed)
+    sim.set_constraints(cell_type = 0, other_cell_type = 1, adhesion = 40)
+    sim.set_constraints(cell_type = 1, other_cell_type = 1, adhesion = 10)
+    sim.set_constraints(cell_type = 2, fixed = 1, secretion = 1.0)
+    sim.set_constraints(cell_type = 1, lambda_chemotaxis = 1000)
+    sim.set_chemokine(diffusion = 4.0, decay = 0.01, interval = 5)
+    state = np.zeros((dimension, dimension), dtype=np.int32)
+    state[:, 0:4] = 1 + (2 << 24)
+    state[:, 40:60] = 2 + (1 << 24)
+    sim.initialize_from_array(state, 2)
+    return sim
+
+results = {}
+for engine in ["serial", "rejection_free"]:
+    fronts = []
+    areas = []
+    for seed in seeds:
+        sim = make_sim(seed)
+        sim.run(ticks, engine=engine)
+        columns = np.nonzero(sim.get_state() == 2)[1]
+        fronts.append(columns.mean())
+        areas.append(len(columns))
+    results[engine] = fronts
+    print("{:16s} mean column {:.1f} +- {:.1f}  area {:.0f} +- {:.0f}".format(
+        engine, np.mean(fronts), np.std(fronts), np.mean(areas), 
+        np.std(areas)))
+
+difference = abs(np.mean(results["serial"]) - 
+        np.mean(results["rejection_free"]))
+error = np.sqrt((np.var(results["serial"]) + 
+    np.var(results["rejection_free"])) / len(seeds))
+print("difference {:.2f}, {}".format(difference, 
+    "agrees" if difference < 3 * error + 0.5 else "DIFFERS"))
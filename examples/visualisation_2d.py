@@ -121,9 +121,8 @@ while running:
         active_cells += 1
 
     sim.run(tick_count)
-    state = sim.get_state()
-    types = state // 2**24
-    ids = state % 2**24
+    ids = sim.get_state()
+    types = sim.get_cell_types()[ids]
     img = np.zeros((dimension,dimension,3),dtype=np.uint8)
     img[ids!=0] = [78, 78, 78]
 
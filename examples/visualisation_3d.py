@@ -178,7 +178,6 @@ def display_lattice(lattice, dimension, vertexBuffer, normalBuffer, indexBuffer,
     lattice[:,:,-1] = 0
 
     #lattice = np.copy(lattice)
-    lattice = lattice % 2**24
 
     if not np.any(lattice == (cellIndex+1)):
         return
@@ -1,12 +1,27 @@
 from distutils.core import setup, Extension
+import os
 import numpy as np
 
+# Energy terms of your own are compiled in from the header named here, see
+# src/hamiltonian_term.h.
+terms_header = os.environ.get('CPM_TERMS_HEADER')
+define_macros = []
+include_dirs = [np.get_include(), 'src']
+if terms_header:
+    terms_header = os.path.abspath(terms_header)
+    define_macros.append(('CPM_TERMS_HEADER', '"%s"' % terms_header))
+    include_dirs.append(os.path.dirname(terms_header))
+
 module1 = Extension('cpm',
                     sources = ['src/python_wrapper.cpp', 'src/cpm.cpp', 'src/lattice_2d.cpp',
                         'src/lattice_3d.cpp', 'src/hamiltonian.cpp', 'src/simulation.cpp',
-                        'src/dice_set.cpp', 'src/ranxoshi256.cpp', 'src/cell_states.cpp',
-                        'src/linalg.cpp', 'src/centroids.cpp'],
-                    include_dirs = [np.get_include(),'src'],
+                        'src/dice_set.cpp', 'src/paged_dice_set.cpp', 'src/ranxoshi256.cpp', 'src/cell_states.cpp',
+                        'src/linalg.cpp', 'src/centroids.cpp', 'src/thread_pool.cpp',
+                        'src/rate_tree.cpp', 'src/neighbor_kernels.cpp', 'src/sparse_memory.cpp',
+                        'src/gradient_field.cpp', 'src/chemokine_field.cpp',
+                        'src/multigrid.cpp', 'src/local_connectivity.cpp'],
+                    include_dirs = include_dirs,
+                    define_macros = define_macros,
                     extra_compile_args=['-std=c++17', '-O3'], )
 
 if __name__ == "__main__": setup( 
@@ -0,0 +1,11 @@
+#ifndef BOUNDARY_H_
+#define BOUNDARY_H_
+
+// What lies past the edge of the lattice along an axis: the opposite face
+// (periodic), or a wall of fixed medium that cells can not copy into.
+enum class Boundary {
+    periodic,
+    wall
+};
+
+#endif // BOUNDARY_H_
@@ -2,19 +2,40 @@
 #include <set>
 #include "cell_states.h"
 #include "lattice.h"
+#include "neighbor_kernels.h"
 
 using namespace std;
 
+template <typename L>
+thread_local typename CellStates<L>::Pending* CellStates<L>::_pending = nullptr;
 
 template <typename L>
-void CellStates<L>::addCell(int area, int perimeter, int type) {
+CellStates<L>::CellStates(L& lattice): _lattice(lattice) {
+}
+
+// Takes the id nextId returned. The cell's type is set on the lattice.
+template <typename L>
+void CellStates<L>::addCell(int area, int perimeter) {
+    if (!_freeIds.empty()) {
+        int id = _freeIds.back();
+        _freeIds.pop_back();
+        _released[id-1] = false;
+        _areas[id-1] = area;
+        _perimeters[id-1] = perimeter;
+        return;
+    }
     _areas.push_back(area);
     _perimeters.push_back(perimeter);
-    _types.push_back(type);
+    _released.push_back(false);
 }
 
 template <typename L>
 int CellStates<L>::getArea(int cellId) {
+    if (_pending) {
+        auto it = _pending->areas.find(cellId);
+        if (it != _pending->areas.end())
+            return _areas[cellId - 1] + it->second;
+    }
     return _areas[cellId - 1];
 }
 
@@ -25,20 +46,28 @@ void CellStates<L>::removeArea(int cellId, int area) {
 
 template <typename L>
 int CellStates<L>::getPerimeter(int cellId) {
+    if (_pending) {
+        auto it = _pending->perimeters.find(cellId);
+        if (it != _pending->perimeters.end())
+            return _perimeters[cellId - 1] + it->second;
+    }
     return _perimeters[cellId - 1];
 }
 
 template <typename L>
 int CellStates<L>::getType(int cellId) {
-    return _types[cellId - 1];
-}
-template <typename L>
-void CellStates<L>::updateType(int cellId, int type) {
-    _types[cellId - 1] = type;
+    return _lattice.getCellType(cellId);
 }
 
 template <typename L>
 void CellStates<L>::updateAreas(LatticePoint& source, LatticePoint& target) {
+    if (_pending) {
+        if (source.cellId != 0)
+            _pending->areas[source.cellId] += 1;
+        if (target.cellId != 0)
+            _pending->areas[target.cellId] -= 1;
+        return;
+    }
     if (source.cellId != 0)
         _areas[source.cellId - 1] += 1;
     if (target.cellId != 0)
@@ -47,33 +76,39 @@ void CellStates<L>::updateAreas(LatticePoint& source, LatticePoint& target) {
 
 template <typename L>
 void CellStates<L>::updatePerimeters(LatticePoint& source, LatticePoint& target, L &lattice) {
-    int oldPerimeterSource = 0;
-    int newPerimeterSource = 0;
-
-    int oldPerimeterTarget = 0;
-    int newPerimeterTarget = 0;
-
-    for (int i = 0; i < lattice.getNeighborCount(); i++) {
-        LatticePoint neighbor = lattice.getNeighbor(target, i);
-        if (neighbor.cellId == source.cellId)
-            oldPerimeterSource++;
-        if (neighbor.cellId != source.cellId)
-            newPerimeterSource++;
-        if (neighbor.cellId != target.cellId)
-            oldPerimeterTarget++;
-        if (neighbor.cellId == target.cellId)
-            newPerimeterTarget++;
-    }
+    Neighborhood neighbors;
+    lattice.getNeighborhood(target, neighbors);
+    updatePerimeters(source, target, neighbors);
+}
+
+// Takes the neighbourhood of the target as gathered for the energy
+// evaluation; copying the target does not change it.
+template <typename L>
+void CellStates<L>::updatePerimeters(LatticePoint& source, LatticePoint& target, 
+        Neighborhood& neighbors) {
+    int oldPerimeterSource;
+    int newPerimeterTarget;
+    neighborKernels().countMatches(neighbors.cellIds, L::neighborCount, 
+            source.cellId, target.cellId, &oldPerimeterSource, 
+            &newPerimeterTarget);
+    int newPerimeterSource = L::neighborCount - oldPerimeterSource;
+    int oldPerimeterTarget = L::neighborCount - newPerimeterTarget;
 
 
     if (source.cellId != 0) {
         int difference = -oldPerimeterSource + newPerimeterSource;
-        _perimeters[source.cellId-1] += difference;
+        if (_pending)
+            _pending->perimeters[source.cellId] += difference;
+        else
+            _perimeters[source.cellId-1] += difference;
     }
 
     if (target.cellId != 0) {
         int difference = -oldPerimeterTarget + newPerimeterTarget;
-        _perimeters[target.cellId-1] += difference;
+        if (_pending)
+            _pending->perimeters[target.cellId] += difference;
+        else
+            _perimeters[target.cellId-1] += difference;
     }
 
 }
@@ -86,9 +121,10 @@ void CellStates<L>::print() {
     }
 }
 
+// The most recently released id, or a new one.
 template <typename L>
 int CellStates<L>::nextId() {
-    return _areas.size() + 1;
+    return _freeIds.empty() ? _areas.size() + 1 : _freeIds.back();
 }
 
 template <typename L>
@@ -96,27 +132,20 @@ void CellStates<L>::initializeFromGrid(L& lattice, int nrOfCells) {
     for (int i = 0; i < nrOfCells; i++) {
         _areas.push_back(0);
         _perimeters.push_back(0);
-        //TODO: don't assume all cells in grid are cell type 1
-        _types.push_back(1);
+        _released.push_back(false);
     }
 
+    // Perimeters are counted from the cell's side, as in recalcPerimeter,
+    // so that neighbours behind a wall count as medium.
     auto size = lattice.size();
     for (int i = 0; i < size; i++) {
-        auto c = lattice.getPoint(i);
-        if (c.cellId != 0) {
-            _areas[c.cellId-1]++;
-        } 
-
-        std::vector<int> neighbors;
+        auto c = lattice.getPoint(lattice.voxelIndex(i));
+        if (c.cellId == 0)
+            continue;
+        _areas[c.cellId-1]++;
         for (int l = 0; l < lattice.getNeighborCount(); l++) {
-            auto n = lattice.getNeighbor(c, l);
-            if (n.cellId != c.cellId && n.cellId != 0) {
-                neighbors.push_back(n.cellId);
-            }
-        }
-
-        for (auto n: neighbors) {
-            _perimeters[n-1]++;
+            if (lattice.getNeighbor(c, l).cellId != c.cellId)
+                _perimeters[c.cellId-1]++;
         }
     }
 
@@ -126,7 +155,7 @@ template <typename L>
 int CellStates<L>::countType(int type) {
     int count = 0;
     for (int i = 0; i < _areas.size(); i++) {
-        if (_types[i] == type && _areas[i] > 0) {
+        if (_areas[i] > 0 && getType(i+1) == type) {
             count++;
         }
     }
@@ -137,7 +166,7 @@ template <typename L>
 std::vector<int> CellStates<L>::getCellIds(int type) {
     std::vector<int> ids;
     for (int i = 0; i < _areas.size(); i++) {
-        if (_types[i] == type && _areas[i] > 0) {
+        if (_areas[i] > 0 && getType(i+1) == type) {
             ids.push_back(i+1);
         }
     }
@@ -148,12 +177,11 @@ template <typename L>
 void CellStates<L>::recalcPerimeter(L& lattice, int id) {
     _perimeters[id-1] = 0;
 
-    auto size = lattice.size();
-    for (int i = 0; i < size; i++) {
+    for (int i: lattice.getCellVoxels(id)) {
         auto c = lattice.getPoint(i);
         for (int l = 0; l < lattice.getNeighborCount(); l++) {
             auto n = lattice.getNeighbor(c, l);
-            if (n.cellId != c.cellId && c.cellId == id) {
+            if (n.cellId != c.cellId) {
                 _perimeters[id-1]++;
             }
         } 
@@ -166,5 +194,32 @@ void CellStates<L>::kill(int id) {
     _perimeters[id-1] = 0;
 }
 
+// Lets the id of a killed cell be taken by the next cell added.
+template <typename L>
+void CellStates<L>::releaseId(int id) {
+    _released[id-1] = true;
+    _freeIds.push_back(id);
+}
+
+template <typename L>
+bool CellStates<L>::hasCell(int id) {
+    return id > 0 && id <= (int)_areas.size() && !_released[id-1];
+}
+
+template <typename L>
+void CellStates<L>::setPending(Pending* pending) {
+    _pending = pending;
+}
+
+template <typename L>
+void CellStates<L>::commitPending(Pending& pending) {
+    for (auto& area: pending.areas)
+        _areas[area.first - 1] += area.second;
+    for (auto& perimeter: pending.perimeters)
+        _perimeters[perimeter.first - 1] += perimeter.second;
+    pending.areas.clear();
+    pending.perimeters.clear();
+}
+
 template class CellStates<Lattice2d>;
 template class CellStates<Lattice3d>;
@@ -2,31 +2,53 @@
 #define CELL_STATES_H
 
 #include <vector>
+#include "flat_hash_map.hpp"
 
 template <typename L>
 class CellStates {
     public:
         typedef typename L::LatticePoint LatticePoint;
-        void addCell(int area, int perimeter, int type);
+        typedef typename L::Neighborhood Neighborhood;
+
+        // Area and perimeter changes made by one block of a parallel sweep.
+        // They stay invisible to other blocks until the phase is committed.
+        struct Pending {
+            ska::flat_hash_map<int, int> areas;
+            ska::flat_hash_map<int, int> perimeters;
+        };
+
+        // Types are read from the lattice, which alone keeps them.
+        CellStates(L& lattice);
+        void addCell(int area, int perimeter);
         int getArea(int cellId);
         void removeArea(int cellId, int area);
         int getPerimeter(int cellId);
         int getType(int cellId);
-        void updateType(int cellId, int type);
         void updateAreas(LatticePoint& source, LatticePoint& target);
         void updatePerimeters(LatticePoint& source, LatticePoint& target, 
                 L& lattice);
+        void updatePerimeters(LatticePoint& source, LatticePoint& target, 
+                Neighborhood& neighbors);
         void print();
         int nextId();
         void initializeFromGrid(L& lattice, int nrOfCells);
         void recalcPerimeter(L& lattice, int id);
         int countType(int type);
         void kill(int id);
+        void releaseId(int id);
+        bool hasCell(int id);
         std::vector<int> getCellIds(int type);
+        void setPending(Pending* pending);
+        void commitPending(Pending& pending);
     private:
+        static thread_local Pending* _pending;
+        L& _lattice;
         std::vector<int> _areas;
         std::vector<int> _perimeters;
-        std::vector<int> _types;
+        // Ids of killed cells that nextId hands out again, and whether each
+        // id is currently among them.
+        std::vector<int> _freeIds;
+        std::vector<bool> _released;
 };
 
 #endif // CELL_STATES_H
@@ -14,14 +14,14 @@ void Centroids<L>::initializeFromGrid(L& lattice, int nrOfCells) {
         _centers.push_back(IntPoint());
         _counts.push_back(0);
         auto p = Point();
-        p.unitRandomize();
+        p.unitRandomize(_rng);
         _preferredDirections.push_back(p);
         _history.push_back(list<Point>());
     }
 
     auto size = lattice.size();
     for (int i = 0; i < size; i++) {
-        auto c = lattice.getPoint(i);
+        auto c = lattice.getPoint(lattice.voxelIndex(i));
         if (c.cellId != 0) {
             _counts[c.cellId-1]++;
             _centers[c.cellId-1] = _centers[c.cellId-1].add(c.times(1));
@@ -31,8 +31,11 @@ void Centroids<L>::initializeFromGrid(L& lattice, int nrOfCells) {
 }
 
 template <typename L>
-Centroids<L>::Centroids(int dimension, int numberOfTypes, CellStates<L>& cellStates): 
-    _dimension(dimension), _cellStates(cellStates) {
+Centroids<L>::Centroids(IntPoint period, int numberOfTypes, CellStates<L>& cellStates,
+        unsigned long long seed): 
+    _period(period), _cellStates(cellStates) {
+        seed_seq sequence{(unsigned int)seed, (unsigned int)(seed >> 32)};
+        _rng.seed(sequence);
         _persistenceValues = new double[numberOfTypes]();
         _historyLengths = new int[numberOfTypes];
         for (int i = 0; i < numberOfTypes; i++) {
@@ -68,12 +71,12 @@ void Centroids<L>::update(LatticePoint& source, LatticePoint& target) {
         auto offset = _centers[source.cellId-1].subtract( 
             target.times(_counts[source.cellId-1]));
         if (_counts[source.cellId-1] > 0)
-            offset = offset.intDiv(_dimension/2 * _counts[source.cellId-1]).mul(_dimension);
+            offset = offset.intDiv(_period.intDiv(2).mul(_counts[source.cellId-1])).mul(_period);
         _counts[source.cellId-1]++;
         _centers[source.cellId-1] = _centers[source.cellId-1].add(target);
         _centers[source.cellId-1] = _centers[source.cellId-1].add(offset);
         _centers[source.cellId-1] = _centers[source.cellId-1].modulo(
-                _counts[source.cellId-1] * _dimension);
+                _period.mul(_counts[source.cellId-1]));
 
 
     }
@@ -82,27 +85,41 @@ void Centroids<L>::update(LatticePoint& source, LatticePoint& target) {
         auto offset = _centers[target.cellId-1].subtract( 
             target.times(_counts[target.cellId-1]));
         if (_counts[target.cellId-1] > 0)
-            offset = offset.intDiv(_dimension/2 * _counts[target.cellId-1]).mul(_dimension);
+            offset = offset.intDiv(_period.intDiv(2).mul(_counts[target.cellId-1])).mul(_period);
         _counts[target.cellId-1]--;
         _centers[target.cellId-1] = _centers[target.cellId-1].subtract(target);
         _centers[target.cellId-1] = _centers[target.cellId-1].subtract(offset);
         if (_counts[target.cellId-1] > 0)
             _centers[target.cellId-1] = _centers[target.cellId-1].modulo(
-                    _counts[target.cellId-1] * _dimension);
+                    _period.mul(_counts[target.cellId-1]));
     }
 
 }
 
+// A recycled id starts over with a new preferred direction and history.
 template <typename L>
-void Centroids<L>::addCentroid(IntPoint center, int count) {
+void Centroids<L>::addCentroid(int cellId, IntPoint center, int count) {
+    auto p = Point();
+    p.unitRandomize(_rng);
+    if (cellId <= (int)_centers.size()) {
+        _centers[cellId-1] = center;
+        _counts[cellId-1] = count;
+        _preferredDirections[cellId-1] = p;
+        _history[cellId-1].clear();
+        return;
+    }
     _centers.push_back(center);
     _counts.push_back(count);
-    auto p = Point();
-    p.unitRandomize();
     _preferredDirections.push_back(p);
     _history.push_back(list<Point>());
 }
 
+template <typename L>
+void Centroids<L>::kill(int cellId) {
+    _centers[cellId-1] = IntPoint();
+    _counts[cellId-1] = 0;
+}
+
 template <typename L>
 void Centroids<L>::print() {
     for (int i = 0; i < _counts.size(); i++) {
@@ -146,7 +163,7 @@ void Centroids<L>::updatePreferentialDirection() {
             continue;
         }
 
-        currentDir = currentDir.wrap(_dimension);
+        currentDir = currentDir.wrap(_period);
 
         currentDir = currentDir.normalize();
 
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <list>
+#include <random>
 
 template <typename L> class CellStates;
 
@@ -13,10 +14,12 @@ class Centroids {
         typedef typename L::Point Point;
         typedef typename L::IntPoint IntPoint;
 
-        Centroids(int dimension, int numberOfTypes, CellStates<L>& cellStates);
+        Centroids(IntPoint period, int numberOfTypes, CellStates<L>& cellStates,
+                unsigned long long seed);
         ~Centroids();
 
-        void addCentroid(IntPoint center, int count);
+        void addCentroid(int cellId, IntPoint center, int count);
+        void kill(int cellId);
         void update(LatticePoint& source, LatticePoint& target);
         std::vector<Point> getCentroids();
         void addCheckpoint();
@@ -32,10 +35,13 @@ class Centroids {
 
         std::vector<std::list<Point>> _history;
         std::vector<Point> _preferredDirections;
-        int _dimension;
+        // Period of each lattice axis, zero along walls, which need no
+        // unwrapping.
+        IntPoint _period;
         int* _historyLengths;
         double* _persistenceValues;
         CellStates<L>& _cellStates;
+        std::mt19937 _rng;
 };
 
 #endif // CENTROIDS_H
@@ -0,0 +1,435 @@
+#include <cmath>
+#include <algorithm>
+#include "chemokine_field.h"
+#include "multigrid.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+ChemokineField::ChemokineField(int numberOfTypes, GradientField& field):
+    _field(field), _enabled(false), _diffusion(0), _decay(0), _timestep(1),
+    _interval(1), _solver(ChemokineSolver::implicitSplit),
+    _secretion(numberOfTypes), _uptake(numberOfTypes), _multigrid(nullptr) {
+    for (int axis = 0; axis < 3; axis++) {
+        _extent[axis] = field.dimension(axis);
+        _periodic[axis] = field.period(axis) > 0;
+    }
+    layout(1);
+}
+
+ChemokineField::~ChemokineField() {
+    delete _multigrid;
+}
+
+// Switches the solver on. The concentration is kept, so it can be set
+// before the first run, unless the coarsening changes. Periodic axes have
+// to be a multiple of the coarsening.
+bool ChemokineField::setDiffusion(double diffusion, double decay,
+        double timestep, int interval, int coarsening,
+        ChemokineSolver solver) {
+    coarsening = max(coarsening, 1);
+    for (int axis = 0; axis < 3; axis++) {
+        if (_periodic[axis] && _extent[axis] % coarsening != 0)
+            return false;
+    }
+    if (coarsening != _coarsening) {
+        layout(coarsening);
+        _concentration.clear();
+    }
+    _enabled = true;
+    _diffusion = diffusion;
+    _decay = decay;
+    _timestep = timestep;
+    _interval = max(interval, 1);
+    _solver = solver;
+    _concentration.resize(_size);
+    _production.resize(_size);
+    _loss.resize(_size);
+    _gradient.resize(_field.components() * _size);
+    if (_solver == ChemokineSolver::explicitEuler)
+        _next.resize(_size);
+    delete _multigrid;
+    _multigrid = nullptr;
+    if (_solver == ChemokineSolver::steadyState)
+        _multigrid = new Multigrid(_dimensions, _period);
+    return true;
+}
+
+void ChemokineField::setSecretion(int type, double secretion) {
+    _secretion[type] = secretion;
+}
+
+void ChemokineField::setUptake(int type, double uptake) {
+    _uptake[type] = uptake;
+}
+
+bool ChemokineField::enabled() {
+    return _enabled;
+}
+
+int ChemokineField::interval() {
+    return _interval;
+}
+
+// Nodes of the grid along an axis.
+int ChemokineField::dimension(int axis) {
+    return _dimensions[axis];
+}
+
+// One value per grid node, laid out like the lattice without its halo.
+double* ChemokineField::getConcentration() {
+    _concentration.resize(_size);
+    return _concentration.data();
+}
+
+// Advances the concentration by one interval, reading the cell of every
+// voxel from cellIds, which points at voxel (0, 0, 0) of the lattice, and
+// its type from cellTypes.
+void ChemokineField::update(const unsigned int* cellIds, 
+        const char* cellTypes, int rowStride, int planeStride, 
+        ThreadPool& pool) {
+    if (!_enabled)
+        return;
+    computeSources(cellIds, cellTypes, rowStride, planeStride, pool);
+    double total = _timestep * _interval;
+    if (_solver == ChemokineSolver::steadyState) {
+        _multigrid->solve(_concentration.data(), _production.data(),
+                _loss.data(), gridDiffusion(), 1e-6, 20, pool);
+    } else if (_solver == ChemokineSolver::implicitSplit) {
+        implicitStep(total, pool);
+    } else {
+        // Substeps short enough to keep every node's own weight positive.
+        double maxUptake = 0;
+        for (double uptake: _uptake)
+            maxUptake = max(maxUptake, uptake);
+        double rate = 2 * _axes * gridDiffusion() + _decay + maxUptake;
+        int substeps = max(1, (int)ceil(total * rate));
+        double* from = _concentration.data();
+        double* to = _next.data();
+        for (int i = 0; i < substeps; i++) {
+            explicitStep(from, to, total / substeps, pool);
+            swap(from, to);
+        }
+        if (from != _concentration.data())
+            copy(_next.begin(), _next.end(), _concentration.begin());
+    }
+    writeGradient(pool);
+}
+
+// Grid nodes sit every coarsening voxels from voxel 0 on. Along walls there
+// are enough of them for the last voxel to have a nearest node.
+void ChemokineField::layout(int coarsening) {
+    _coarsening = coarsening;
+    _axes = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        int n = _extent[axis];
+        if (n == 1)
+            _dimensions[axis] = 1;
+        else if (_periodic[axis])
+            _dimensions[axis] = n / coarsening;
+        else
+            _dimensions[axis] = (n - 1 + coarsening / 2) / coarsening + 1;
+        _period[axis] = _periodic[axis] ? _dimensions[axis] : 0;
+        _axes += _dimensions[axis] > 1;
+    }
+    _size = (size_t)_dimensions[0] * _dimensions[1] * _dimensions[2];
+}
+
+// Diffusion in grid units.
+double ChemokineField::gridDiffusion() {
+    return _diffusion / ((double)_coarsening * _coarsening);
+}
+
+// The node nearest to a voxel.
+int ChemokineField::nodeOf(int coordinate, int axis) {
+    int node = (coordinate + _coarsening / 2) / _coarsening;
+    return _periodic[axis] ? node % _dimensions[axis] : node;
+}
+
+// The offset-th of the voxels nearest to a node along an axis, or -1 past a
+// wall.
+int ChemokineField::voxelOf(int node, int offset, int axis) {
+    if (_extent[axis] == 1)
+        return offset == 0 ? 0 : -1;
+    int voxel = node * _coarsening - _coarsening / 2 + offset;
+    if (_periodic[axis])
+        return (voxel + _extent[axis]) % _extent[axis];
+    return voxel >= 0 && voxel < _extent[axis] ? voxel : -1;
+}
+
+// The node one step along an axis. Past a wall this is the node itself,
+// which leaves no flux through the wall.
+int ChemokineField::neighbor(int coordinate, int step, int axis) {
+    int next = coordinate + step;
+    if (next >= 0 && next < _dimensions[axis])
+        return next;
+    if (_period[axis] == 0)
+        return coordinate;
+    return (next + _dimensions[axis]) % _dimensions[axis];
+}
+
+// Average secretion and loss over the voxels nearest to each node.
+void ChemokineField::computeSources(const unsigned int* cellIds,
+        const char* cellTypes, int rowStride, int planeStride, 
+        ThreadPool& pool) {
+    const int width = _dimensions[0];
+    const int spanY = _extent[1] > 1 ? _coarsening : 1;
+    const int spanZ = _extent[2] > 1 ? _coarsening : 1;
+    pool.runRanges(_dimensions[1] * _dimensions[2], [&](int begin,
+                int end) {
+        vector<int> counts(width);
+        for (int row = begin; row < end; row++) {
+            double* production = &_production[(size_t)row * width];
+            double* loss = &_loss[(size_t)row * width];
+            fill(production, production + width, 0.0);
+            fill(loss, loss + width, 0.0);
+            fill(counts.begin(), counts.end(), 0);
+            for (int dz = 0; dz < spanZ; dz++) {
+                int z = voxelOf(row / _dimensions[1], dz, 2);
+                for (int dy = 0; z >= 0 && dy < spanY; dy++) {
+                    int y = voxelOf(row % _dimensions[1], dy, 1);
+                    if (y < 0)
+                        continue;
+                    const unsigned int* ids = cellIds +
+                        (size_t)z * planeStride + (size_t)y * rowStride;
+                    for (int x = 0; x < _extent[0]; x++) {
+                        int node = nodeOf(x, 0);
+                        int type = cellTypes[ids[x]];
+                        production[node] += _secretion[type];
+                        loss[node] += _uptake[type];
+                        counts[node]++;
+                    }
+                }
+            }
+            for (int x = 0; x < width; x++) {
+                production[x] /= max(counts[x], 1);
+                loss[x] = _decay + loss[x] / max(counts[x], 1);
+            }
+        }
+    });
+}
+
+// Forward Euler over the five or seven point stencil, a row at a time so the
+// inner loops vectorise.
+void ChemokineField::explicitStep(const double* from, double* to, double dt,
+        ThreadPool& pool) {
+    const int width = _dimensions[0];
+    const double diffusion = gridDiffusion();
+    pool.runRanges(_dimensions[1] * _dimensions[2], [&](int begin,
+                int end) {
+        vector<double> laplace(width);
+        for (int row = begin; row < end; row++) {
+            int y = row % _dimensions[1];
+            int z = row / _dimensions[1];
+            const double* c = from + (size_t)row * width;
+            for (int x = 0; x < width; x++)
+                laplace[x] = -2 * _axes * c[x];
+            if (width > 1) {
+                for (int x = 1; x < width - 1; x++)
+                    laplace[x] += c[x - 1] + c[x + 1];
+                laplace[0] += c[1] + c[neighbor(0, -1, 0)];
+                laplace[width - 1] += c[width - 2] +
+                    c[neighbor(width - 1, 1, 0)];
+            }
+            for (int axis = 1; axis < 3; axis++) {
+                if (_dimensions[axis] == 1)
+                    continue;
+                for (int step = -1; step <= 1; step += 2) {
+                    int other = axis == 1 ?
+                        z * _dimensions[1] + neighbor(y, step, 1) :
+                        neighbor(z, step, 2) * _dimensions[1] + y;
+                    const double* c2 = from + (size_t)other * width;
+                    for (int x = 0; x < width; x++)
+                        laplace[x] += c2[x];
+                }
+            }
+            const double* production = &_production[(size_t)row * width];
+            const double* loss = &_loss[(size_t)row * width];
+            double* out = to + (size_t)row * width;
+            for (int x = 0; x < width; x++)
+                out[x] = c[x] + dt * (diffusion * laplace[x] -
+                        loss[x] * c[x] + production[x]);
+        }
+    });
+}
+
+// Secretion and uptake first, then diffusion one axis at a time. Lines
+// along y and z are solved a whole row of x at once, lines along x a few
+// rows at once.
+void ChemokineField::implicitStep(double dt, ThreadPool& pool) {
+    const int width = _dimensions[0];
+    double* c = _concentration.data();
+    pool.runRanges(_dimensions[1] * _dimensions[2], [&](int begin,
+                int end) {
+        for (size_t i = (size_t)begin * width; i < (size_t)end * width; i++)
+            c[i] = (c[i] + dt * _production[i]) / (1 + dt * _loss[i]);
+    });
+    for (int axis = 0; axis < 3; axis++) {
+        if (_dimensions[axis] == 1)
+            continue;
+        AxisSystem system = factor(axis, dt);
+        const int rows = _dimensions[1] * _dimensions[2];
+        const int rowBatch = 8;
+        int lines = axis == 0 ? rowBatch : width;
+        int batches = axis == 0 ? (rows + rowBatch - 1) / rowBatch :
+            (axis == 1 ? _dimensions[2] : _dimensions[1]);
+        size_t batchStride = axis == 0 ? (size_t)rowBatch * width : 
+            (axis == 1 ? (size_t)width * _dimensions[1] : width);
+        size_t lineSpacing = axis == 0 ? width : 1;
+        pool.runRanges(batches, [&](int begin, int end) {
+            vector<double> corrections(lines);
+            for (int batch = begin; batch < end; batch++) {
+                int count = axis == 0 ? 
+                    min(rowBatch, rows - batch * rowBatch) : lines;
+                solveLines(system, c + batch * batchStride, count, 
+                        lineSpacing, corrections);
+            }
+        });
+    }
+}
+
+// Thomas factorisation of (1 - dt * diffusion * second difference), with the
+// wall rows keeping their single neighbour.
+ChemokineField::AxisSystem ChemokineField::factor(int axis, double dt) {
+    AxisSystem system;
+    int n = _dimensions[axis];
+    double r = gridDiffusion() * dt;
+    system.length = n;
+    system.stride = axis == 0 ? 1 : (axis == 1 ? _dimensions[0] :
+            (size_t)_dimensions[0] * _dimensions[1]);
+    system.periodic = _period[axis] > 0;
+    system.coupling = r;
+    vector<double> diagonal(n, 1 + 2 * r);
+    double gamma = 0;
+    if (system.periodic) {
+        gamma = -diagonal[0];
+        diagonal[0] -= gamma;
+        diagonal[n - 1] -= r * r / gamma;
+        system.cornerRatio = -r / gamma;
+    } else {
+        diagonal[0] = 1 + r;
+        diagonal[n - 1] = 1 + r;
+    }
+    system.upper.resize(n);
+    system.scale.resize(n);
+    for (int k = 0; k < n; k++) {
+        double pivot = diagonal[k] + (k > 0 ? r * system.upper[k - 1] : 0);
+        system.scale[k] = 1 / pivot;
+        system.upper[k] = -r / pivot;
+    }
+    if (system.periodic) {
+        auto& z = system.cyclic;
+        z.assign(n, 0);
+        z[0] = gamma;
+        z[n - 1] = -r;
+        z[0] *= system.scale[0];
+        for (int k = 1; k < n; k++)
+            z[k] = (z[k] + r * z[k - 1]) * system.scale[k];
+        for (int k = n - 2; k >= 0; k--)
+            z[k] -= system.upper[k] * z[k + 1];
+        system.cyclicFactor = 1 / (1 + z[0] + system.cornerRatio * z[n - 1]);
+    }
+    return system;
+}
+
+// Solves count lines in place, the k-th value of line j being at
+// start[k * stride + j * spacing].
+void ChemokineField::solveLines(const AxisSystem& system, double* start,
+        int count, size_t spacing, vector<double>& corrections) {
+    const int n = system.length;
+    const size_t stride = system.stride;
+    const double r = system.coupling;
+    for (int j = 0; j < count; j++)
+        start[j * spacing] *= system.scale[0];
+    for (int k = 1; k < n; k++) {
+        double* row = start + k * stride;
+        const double scale = system.scale[k];
+        for (int j = 0; j < count; j++)
+            row[j * spacing] = (row[j * spacing] + 
+                    r * row[j * spacing - stride]) * scale;
+    }
+    for (int k = n - 2; k >= 0; k--) {
+        double* row = start + k * stride;
+        const double upper = system.upper[k];
+        for (int j = 0; j < count; j++)
+            row[j * spacing] -= upper * row[j * spacing + stride];
+    }
+    if (!system.periodic)
+        return;
+    const double* last = start + (n - 1) * stride;
+    for (int j = 0; j < count; j++)
+        corrections[j] = (start[j * spacing] + 
+                system.cornerRatio * last[j * spacing]) * system.cyclicFactor;
+    for (int k = 0; k < n; k++) {
+        double* row = start + k * stride;
+        const double z = system.cyclic[k];
+        for (int j = 0; j < count; j++)
+            row[j * spacing] -= corrections[j] * z;
+    }
+}
+
+// Central differences, one sided next to walls. A coarse field takes the
+// gradient at the grid nodes, which it shares.
+void ChemokineField::writeGradient(ThreadPool& pool) {
+    const int width = _dimensions[0];
+    const int components = _field.components();
+    const double scale = 0.5 / _coarsening;
+    const double* c = _concentration.data();
+    pool.runRanges(_dimensions[1] * _dimensions[2], [&](int begin,
+                int end) {
+        for (int row = begin; row < end; row++) {
+            int y = row % _dimensions[1];
+            int z = row / _dimensions[1];
+            const double* center = c + (size_t)row * width;
+            double* out = &_gradient[(size_t)row * width];
+            for (int x = 1; x < width - 1; x++)
+                out[x] = scale * (center[x + 1] - center[x - 1]);
+            out[0] = scale * (center[neighbor(0, 1, 0)] -
+                    center[neighbor(0, -1, 0)]);
+            out[width - 1] = scale * (center[neighbor(width - 1, 1, 0)] -
+                    center[neighbor(width - 1, -1, 0)]);
+            for (int axis = 1; axis < components; axis++) {
+                int coordinate = axis == 1 ? y : z;
+                int rows[2];
+                for (int side = 0; side < 2; side++) {
+                    int other = neighbor(coordinate, side ? 1 : -1, axis);
+                    rows[side] = axis == 1 ? z * _dimensions[1] + other :
+                        other * _dimensions[1] + y;
+                }
+                const double* below = c + (size_t)rows[0] * width;
+                const double* above = c + (size_t)rows[1] * width;
+                out = &_gradient[axis * _size + (size_t)row * width];
+                for (int x = 0; x < width; x++)
+                    out[x] = scale * (above[x] - below[x]);
+            }
+        }
+    });
+    if (_coarsening == 1) {
+        _field.assign(_gradient.data());
+        return;
+    }
+    _field.setStorage(FieldStorage::coarse, _coarsening);
+    double* values = (double*)_field.data();
+    int counts[3];
+    for (int axis = 0; axis < 3; axis++)
+        counts[axis] = _field.nodes(axis);
+    size_t i = 0;
+    for (int component = 0; component < components; component++) {
+        for (int iz = 0; iz < counts[2]; iz++) {
+            for (int iy = 0; iy < counts[1]; iy++) {
+                for (int ix = 0; ix < counts[0]; ix++, i++) {
+                    int node[3] = {ix, iy, iz};
+                    for (int axis = 0; axis < 3; axis++) {
+                        if (node[axis] >= _dimensions[axis])
+                            node[axis] = _periodic[axis] ?
+                                node[axis] % _dimensions[axis] :
+                                _dimensions[axis] - 1;
+                    }
+                    values[i] = _gradient[component * _size +
+                        ((size_t)node[2] * _dimensions[1] + node[1]) *
+                        width + node[0]];
+                }
+            }
+        }
+    }
+}
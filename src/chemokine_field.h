@@ -0,0 +1,101 @@
+#ifndef CHEMOKINE_FIELD_H_
+#define CHEMOKINE_FIELD_H_
+
+#include <vector>
+#include "gradient_field.h"
+
+class ThreadPool;
+class Multigrid;
+
+// explicitEuler takes as many forward Euler substeps as stability needs.
+// implicitSplit takes a single backward Euler step, split into one
+// tridiagonal solve per axis, which is stable for any time step.
+// steadyState jumps straight to the steady state for the current cells,
+// with multigrid V-cycles started from the previous one.
+enum class ChemokineSolver {
+    explicitEuler,
+    implicitSplit,
+    steadyState
+};
+
+// A chemokine that diffuses, decays, and is secreted and taken up by cells
+// according to the type of the voxel:
+//     dc/dt = diffusion * laplace(c) - decay * c + secretion - uptake * c
+// Walls have no flux through them. Every interval Monte Carlo steps the
+// concentration is advanced by interval * timestep and its gradient is
+// written to the field chemotaxis follows.
+//
+// The concentration lives on a grid with a node every coarsening voxels
+// along each axis, each node standing for the voxels nearest to it. With a
+// coarsening above one the field is kept coarse as well and interpolated
+// wherever chemotaxis reads it.
+class ChemokineField {
+    public:
+        ChemokineField(int numberOfTypes, GradientField& field);
+        ~ChemokineField();
+        bool setDiffusion(double diffusion, double decay, double timestep,
+                int interval, int coarsening, ChemokineSolver solver);
+        void setSecretion(int type, double secretion);
+        void setUptake(int type, double uptake);
+        bool enabled();
+        int interval();
+        int dimension(int axis);
+        double* getConcentration();
+        void update(const unsigned int* cellIds, const char* cellTypes,
+                int rowStride, int planeStride, ThreadPool& pool);
+    private:
+        // Factored system of one implicit step along an axis. Periodic axes
+        // are cyclic and are solved with the Sherman-Morrison correction.
+        struct AxisSystem {
+            int length;
+            size_t stride;
+            bool periodic;
+            double coupling;
+            std::vector<double> upper;
+            std::vector<double> scale;
+            std::vector<double> cyclic;
+            double cornerRatio;
+            double cyclicFactor;
+        };
+        void layout(int coarsening);
+        double gridDiffusion();
+        int neighbor(int coordinate, int step, int axis);
+        int nodeOf(int coordinate, int axis);
+        int voxelOf(int node, int offset, int axis);
+        void computeSources(const unsigned int* cellIds,
+                const char* cellTypes, int rowStride, int planeStride,
+                ThreadPool& pool);
+        void explicitStep(const double* from, double* to, double dt,
+                ThreadPool& pool);
+        void implicitStep(double dt, ThreadPool& pool);
+        AxisSystem factor(int axis, double dt);
+        void solveLines(const AxisSystem& system, double* start, int count,
+                size_t spacing, std::vector<double>& corrections);
+        void writeGradient(ThreadPool& pool);
+        GradientField& _field;
+        // Extent of the lattice and whether it is periodic, along each axis.
+        int _extent[3];
+        bool _periodic[3];
+        // The grid the concentration is solved on.
+        int _coarsening;
+        int _dimensions[3];
+        int _period[3];
+        size_t _size;
+        int _axes;
+        bool _enabled;
+        double _diffusion;
+        double _decay;
+        double _timestep;
+        int _interval;
+        ChemokineSolver _solver;
+        std::vector<double> _secretion;
+        std::vector<double> _uptake;
+        std::vector<double> _concentration;
+        std::vector<double> _next;
+        std::vector<double> _production;
+        std::vector<double> _loss;
+        std::vector<double> _gradient;
+        Multigrid* _multigrid;
+};
+
+#endif // CHEMOKINE_FIELD_H_
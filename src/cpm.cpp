@@ -1,14 +1,21 @@
 #include "cpm.h"
+#include "thread_pool.h"
 
 using namespace std;
 
 template <typename L>
-Cpm<L>::Cpm(int dimension, int numberOfTypes, double temperature):
-    _lattice(dimension), _hamiltonian(numberOfTypes, temperature), 
-    _centroids(dimension, numberOfTypes, _cellStates), _simulation(_lattice, _hamiltonian, _cellStates, 
-    _centroids, nullptr), nrOfCells(0)
+Cpm<L>::Cpm(IntPoint dimensions, const std::vector<Boundary>& boundaries,
+        int numberOfTypes, double temperature, unsigned long long seed):
+    _lastCellId(0), _lattice(dimensions, boundaries), _cellStates(_lattice),
+    _centroids(_lattice.period(), numberOfTypes, _cellStates, seed), 
+    _hamiltonian(numberOfTypes, temperature), 
+    _chemokine(numberOfTypes, _lattice.getField()),
+    _simulation(_lattice, _hamiltonian, _cellStates, _centroids, &_chemokine,
+            seed), _divisionRng(seed + 1)
 {
     _thread = nullptr;
+    _hamiltonian.attachTerms(_lattice, _cellStates, _centroids, 
+            _simulation._time);
 }
 
 template <typename L>
@@ -17,7 +24,186 @@ Cpm<L>::~Cpm() {
 
 template <typename L>
 void Cpm<L>::updateType(int id, int type) { 
-    _cellStates.updateType(id, type);
+    _lattice.setCellType(id, type);
+}
+
+// Turns a cell into medium, visiting only its own voxels. Neighbouring
+// cells keep their perimeters, as medium borders them just as the cell did.
+// A recycled id is taken by the next cell added or split off.
+template <typename L>
+void Cpm<L>::killCell(int id, bool recycle) {
+    if (!_cellStates.hasCell(id))
+        return;
+    auto voxels = _lattice.getCellVoxels(id);
+    char type = _lattice.getCellType(id);
+    _lattice.remove(id);
+    for (int i: voxels) {
+        auto source = _lattice.getPoint(i);
+        auto target = source;
+        target.cellId = id;
+        target.type = type;
+        _hamiltonian.onAccept(source, target);
+    }
+    _cellStates.kill(id);
+    _centroids.kill(id);
+    if (recycle)
+        _cellStates.releaseId(id);
+}
+
+// Offset along an axis to the nearest periodic image, see Point::wrap.
+static int unwrap(int offset, int period) {
+    if (period && offset > period/2)
+        return offset - period;
+    if (period && offset < -period/2)
+        return offset + period;
+    return offset;
+}
+
+// Voxels of a cell on the positive side of the dividing plane through its
+// centroid. Coordinates are taken relative to the first voxel, so cells
+// across periodic edges are split as a whole, and the plane is tilted
+// slightly off the lattice axes to share the voxels lying on it evenly.
+static vector<int> splitVoxels(Lattice2d& lattice, const vector<int>& voxels,
+        DivisionAxis axis, Lattice2d::Point direction) {
+    auto period = lattice.period();
+    auto first = lattice.getPoint(voxels[0]);
+    vector<vec2> points;
+    points.reserve(voxels.size());
+    for (int i: voxels) {
+        auto p = lattice.getPoint(i);
+        points.push_back({(float)unwrap(p.x - first.x, period.x), 
+                (float)unwrap(p.y - first.y, period.y)});
+    }
+    auto average = calculateAverage(points);
+    vec2 normal = {(float)direction.x, (float)direction.y};
+    if (axis != DivisionAxis::random) {
+        auto covariance = calculateCovarianceMatrix(points, average);
+        auto values = calculateEigenValues(covariance);
+        normal = calculateEigenVector(covariance, 
+                axis == DivisionAxis::major ? values[0] : values[1]);
+        normal = normal.normalize();
+    }
+    normal += {3.1e-4f, 5.3e-4f};
+    vector<int> side;
+    for (size_t k = 0; k < points.size(); k++) {
+        if ((points[k] - average).dot(normal) > 0)
+            side.push_back(voxels[k]);
+    }
+    return side;
+}
+
+static vector<int> splitVoxels(Lattice3d& lattice, const vector<int>& voxels,
+        DivisionAxis axis, Lattice3d::Point direction) {
+    auto period = lattice.period();
+    auto first = lattice.getPoint(voxels[0]);
+    vector<vec3> points;
+    points.reserve(voxels.size());
+    for (int i: voxels) {
+        auto p = lattice.getPoint(i);
+        points.push_back({(float)unwrap(p.x - first.x, period.x), 
+                (float)unwrap(p.y - first.y, period.y),
+                (float)unwrap(p.z - first.z, period.z)});
+    }
+    auto average = calculateAverage(points);
+    vec3 normal = {(float)direction.x, (float)direction.y, 
+        (float)direction.z};
+    if (axis != DivisionAxis::random) {
+        auto covariance = calculateCovarianceMatrix(points, average);
+        auto values = calculateEigenValues(covariance);
+        normal = calculateEigenVector(covariance, 
+                axis == DivisionAxis::major ? values[0] : values[2]);
+    }
+    normal += {3.1e-4f, 5.3e-4f, 7.9e-4f};
+    vector<int> side;
+    for (size_t k = 0; k < points.size(); k++) {
+        if ((points[k] - average).dot(normal) > 0)
+            side.push_back(voxels[k]);
+    }
+    return side;
+}
+
+// Returns the id of the new cell, or 0 when the cell cannot be split.
+template <typename L>
+int Cpm<L>::divideCell(int id, DivisionAxis axis) {
+    return divideCells({id}, axis)[0];
+}
+
+// Splits are found in parallel and applied one cell after the other, in
+// the order of ids, each voxel of a daughter being copied over like in a
+// Monte Carlo step so that areas, perimeters, centroids and the border set
+// follow incrementally. Random directions are drawn before, which keeps
+// the result independent of the number of threads.
+template <typename L>
+std::vector<int> Cpm<L>::divideCells(const std::vector<int>& ids, 
+        DivisionAxis axis, int threads) {
+    int count = ids.size();
+    vector<Point> directions(count);
+    if (axis == DivisionAxis::random) {
+        for (auto& direction: directions)
+            direction.unitRandomize(_divisionRng);
+    }
+
+    vector<bool> seen;
+    vector<int> cells(count, 0);
+    for (int k = 0; k < count; k++) {
+        int id = ids[k];
+        if (!_cellStates.hasCell(id))
+            continue;
+        if (id >= (int)seen.size())
+            seen.resize(id + 1);
+        if (!seen[id]) {
+            seen[id] = true;
+            cells[k] = id;
+        }
+    }
+
+    // The voxel index is built on first use, which must not happen on the
+    // worker threads.
+    _lattice.getCellVoxels(0);
+    vector<vector<int>> sides(count);
+    auto split = [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            auto& voxels = _lattice.getCellVoxels(cells[k]);
+            if (cells[k] && voxels.size() > 1)
+                sides[k] = splitVoxels(_lattice, voxels, axis, directions[k]);
+        }
+    };
+    // A pool of its own leaves the engine's pool, and the state kept for
+    // it, as the last run set them up.
+    if (threads > 1 && count > 1) {
+        ThreadPool pool(threads);
+        pool.runRanges(count, split);
+    } else {
+        split(0, count);
+    }
+
+    vector<int> newIds(count, 0);
+    for (int k = 0; k < count; k++) {
+        if (!sides[k].empty())
+            newIds[k] = splitCell(cells[k], sides[k]);
+    }
+    return newIds;
+}
+
+template <typename L>
+int Cpm<L>::splitCell(int id, const std::vector<int>& voxels) {
+    auto type = _cellStates.getType(id);
+    auto newId = _cellStates.nextId();
+    _cellStates.addCell(0, 0);
+    _centroids.addCentroid(newId, IntPoint(), 0);
+    _lattice.setCellType(newId, type);
+    _lastCellId = newId;
+    for (int i: voxels) {
+        auto target = _lattice.getPoint(i);
+        auto source = target;
+        source.cellId = newId;
+        _lattice.copy(source, target, _lattice.getAct(target));
+        _cellStates.updateAreas(source, target);
+        _cellStates.updatePerimeters(source, target, _lattice);
+        _centroids.update(source, target);
+        _hamiltonian.onAccept(source, target);
+    }
+    return newId;
 }
 
 template <typename L>
@@ -33,6 +219,16 @@ void Cpm<L>::setPersistenceConstraints(int type, double lambda, int history,
     _centroids.setPersistence(type, persistence);
 }
 
+template <typename L>
+bool Cpm<L>::hasTermParameter(const char* name) {
+    return _hamiltonian.hasTermParameter(name);
+}
+
+template <typename L>
+void Cpm<L>::setTermParameter(int type, const char* name, double value) {
+    _hamiltonian.setTermParameter(type, name, value);
+}
+
 template <typename L>
 void Cpm<L>::setAreaConstraints(int type, double lambda, int target) { 
     _hamiltonian.setAreaConstraints(type, lambda, target);
@@ -63,6 +259,23 @@ void Cpm<L>::setChemotaxisConstraints(int type, double lambda) {
     _hamiltonian.setChemotaxisConstraints(type, lambda);
 }
 
+template <typename L>
+bool Cpm<L>::setChemokine(double diffusion, double decay, double timestep,
+        int interval, int coarsening, ChemokineSolver solver) { 
+    return _chemokine.setDiffusion(diffusion, decay, timestep, interval, 
+            coarsening, solver);
+}
+
+template <typename L>
+void Cpm<L>::setSecretion(int type, double secretion) { 
+    _chemokine.setSecretion(type, secretion);
+}
+
+template <typename L>
+void Cpm<L>::setUptake(int type, double uptake) { 
+    _chemokine.setUptake(type, uptake);
+}
+
 template <typename L>
 void Cpm<L>::updateCellProps(int nrOfCells) {
     _cellStates.initializeFromGrid(_lattice, nrOfCells);
@@ -70,18 +283,56 @@ void Cpm<L>::updateCellProps(int nrOfCells) {
 }
 
 template <typename L>
-void Cpm<L>::run(int ticks) {
+void Cpm<L>::setAcceptance(Acceptance acceptance, int tableSize) {
+    _hamiltonian.setBoltzmannTable(tableSize);
+    _simulation.setAcceptance(acceptance);
+}
+
+// Lets the lattice count the neighbour types of every voxel, from which
+// adhesion deltas follow without reading the adhesion of each neighbour.
+template <typename L>
+void Cpm<L>::setAdhesionCache(bool enabled) {
+    _lattice.keepTypeCounts(enabled ? _hamiltonian.getNumberOfTypes() : 0);
+}
+
+template <typename L>
+void Cpm<L>::run(int ticks, int threads, Engine engine) {
     _hamiltonian.updateConstraintToggles();
-    _lattice.setAct(_hamiltonian.getActEnabled());
+    _simulation.selectKernels();
+    if (_hamiltonian.getActEnabled())
+        _lattice.allocateActValues();
+    _simulation.setThreads(threads);
+    _simulation.resetStats();
+    _simulation.invalidateRates();
+    if (engine == Engine::automatic)
+        engine = threads > 1 ? Engine::checkerboard : Engine::serial;
     for (int i = 0; i < ticks; i++) {
-        _simulation.monteCarloStep();
-        
+        if (engine == Engine::checkerboard)
+            _simulation.stratifiedMonteCarloStep();
+        else if (engine == Engine::speculative)
+            _simulation.speculativeMonteCarloStep();
+        else if (engine == Engine::rejectionFree)
+            _simulation.rejectionFreeMonteCarloStep();
+        else
+            _simulation.monteCarloStep();
+        _simulation.updateChemokine();
+        _lattice.releaseEmptyBricks();
     }
 }
 
 template <typename L>
-void Cpm<L>::runAsync(int ticks) {
-    _thread = new thread(&Cpm::run, this, ticks);
+void Cpm<L>::runAsync(int ticks, int threads, Engine engine) {
+    _thread = new thread(&Cpm::run, this, ticks, threads, engine);
+}
+
+template <typename L>
+EngineStats Cpm<L>::getEngineStats() {
+    return _simulation.getStats();
+}
+
+template <typename L>
+unsigned long long Cpm<L>::getSeed() {
+    return _simulation.getSeed();
 }
 
 template <typename L>
@@ -96,18 +347,33 @@ unsigned int* Cpm<L>::getData() {
 }
 
 template <typename L>
-double* Cpm<L>::getField() {
-    return _lattice._field;
+const std::vector<char>& Cpm<L>::getCellTypes() {
+    return _lattice.getCellTypes();
+}
+
+template <typename L>
+GradientField& Cpm<L>::getField() {
+    return _lattice.getField();
+}
+
+template <typename L>
+ChemokineField& Cpm<L>::getChemokine() {
+    return _chemokine;
 }
 
 template <typename L>
 int* Cpm<L>::getActData() {
-    return _lattice._actValues;
+    return _lattice.getActValues();
+}
+
+template <typename L>
+int Cpm<L>::getStride(int axis) {
+    return _lattice.stride(axis);
 }
 
 template <typename L>
-int Cpm<L>::getDimension() {
-    return _lattice._dimension;
+typename L::IntPoint Cpm<L>::getDimensions() {
+    return _lattice._dimensions;
 }
 
 template <typename L>
@@ -3,6 +3,7 @@
 
 #include <thread>
 #include <type_traits>
+#include <random>
 
 
 
@@ -11,14 +12,25 @@
 #include "hamiltonian.h"
 #include "centroids.h"
 #include "simulation.h"
+#include "chemokine_field.h"
 
 
+// Normal of the plane through the centroid that divides a cell: its major
+// axis, giving two rounder daughters, its minor axis, or a random direction.
+enum class DivisionAxis {
+    major,
+    minor,
+    random
+};
 
 template <typename L>
 class Cpm {
     public:
         typedef typename L::Point Point;
-        Cpm(int dimension, int numberOfTypes, double temperature);
+        typedef typename L::IntPoint IntPoint;
+        Cpm(IntPoint dimensions, const std::vector<Boundary>& boundaries,
+                int numberOfTypes, double temperature,
+                unsigned long long seed = randomSeed());
         ~Cpm();
         void setFixedConstraint(int type, bool fixed);
         void setAdhesionBetweenTypes(int type, int other, int adhesion);
@@ -27,17 +39,36 @@ class Cpm {
         void setActConstraints(int type, double lambda, int max);
         void setConnectedConstraints(int type, double lambda);
         void setChemotaxisConstraints(int type, double lambda);
+        bool setChemokine(double diffusion, double decay, double timestep,
+                int interval, int coarsening, ChemokineSolver solver);
+        void setSecretion(int type, double secretion);
+        void setUptake(int type, double uptake);
+        void setAcceptance(Acceptance acceptance, int tableSize);
+        void setAdhesionCache(bool enabled);
         void setPersistenceConstraints(int type, double lambda, int history, 
                 double persistence);
+        bool hasTermParameter(const char* name);
+        void setTermParameter(int type, const char* name, double value);
         void updateType(int id, int type);
-        void run(int ticks);
-        void runAsync(int ticks);
+        void killCell(int id, bool recycle);
+        int divideCell(int id, DivisionAxis axis);
+        std::vector<int> divideCells(const std::vector<int>& ids, 
+                DivisionAxis axis, int threads = 1);
+        void run(int ticks, int threads = 1, 
+                Engine engine = Engine::automatic);
+        void runAsync(int ticks, int threads = 1, 
+                Engine engine = Engine::automatic);
+        EngineStats getEngineStats();
+        unsigned long long getSeed();
         void join();
         unsigned int* getData();
-        double* getField();
+        const std::vector<char>& getCellTypes();
+        GradientField& getField();
+        ChemokineField& getChemokine();
         int* getActData();
         void updateCellProps(int nrOfCells);
-        int getDimension();
+        IntPoint getDimensions();
+        int getStride(int axis);
 
         std::vector<Point> getCentroids();
 
@@ -47,8 +78,9 @@ class Cpm {
                 auto source = _lattice.getPoint(x, y);
                 auto target = source;
                 source.type = type;
-                source.cellId = nrOfCells;
-                _lattice.copy(source, target, source.act);
+                source.cellId = _lastCellId;
+                _lattice.setCellType(_lastCellId, type);
+                _lattice.copy(source, target, _lattice.getAct(source));
                 _cellStates.updateAreas(source, target);
                 _cellStates.updatePerimeters(source, target, _lattice);
                 _centroids.update(source, target);
@@ -60,8 +92,9 @@ class Cpm {
                 auto source = _lattice.getPoint(x, y, z);
                 auto target = source;
                 source.type = type;
-                source.cellId = nrOfCells;
-                _lattice.copy(source, target, source.act);
+                source.cellId = _lastCellId;
+                _lattice.setCellType(_lastCellId, type);
+                _lattice.copy(source, target, _lattice.getAct(source));
                 _cellStates.updateAreas(source, target);
                 _cellStates.updatePerimeters(source, target, _lattice);
                 _centroids.update(source, target);
@@ -83,18 +116,20 @@ class Cpm {
             std::is_same<U, Lattice2d>::value, int>::type = 0>
             void addCell(int type) {
                 auto cellId = _cellStates.nextId();
-                _cellStates.addCell(0, 0, type);
-                _centroids.addCentroid({0,0}, 0);
-                nrOfCells++;
+                _cellStates.addCell(0, 0);
+                _lattice.setCellType(cellId, type);
+                _centroids.addCentroid(cellId, {0,0}, 0);
+                _lastCellId = cellId;
             }
 
         template<typename U = L, typename std::enable_if<
             std::is_same<U, Lattice3d>::value, int>::type = 0>
             void addCell(int type) {
                 auto cellId = _cellStates.nextId();
-                _cellStates.addCell(1, 26, type);
-                _centroids.addCentroid({0,0,0}, 0);
-                nrOfCells++;
+                _cellStates.addCell(1, 26);
+                _lattice.setCellType(cellId, type);
+                _centroids.addCentroid(cellId, {0,0,0}, 0);
+                _lastCellId = cellId;
             }
 
         template<typename U = L, typename std::enable_if<
@@ -102,9 +137,9 @@ class Cpm {
             void addCell(int x, int y, int type) {
                 auto cellId = _cellStates.nextId();
                 _lattice.setPoint(cellId, x, y, 0, type);
-                _cellStates.addCell(1, 8, type);
-                _centroids.addCentroid({x,y}, 1);
-                nrOfCells++;
+                _cellStates.addCell(1, 8);
+                _centroids.addCentroid(cellId, {x,y}, 1);
+                _lastCellId = cellId;
             }
 
         template<typename U = L, typename std::enable_if<
@@ -112,18 +147,22 @@ class Cpm {
             void addCell(int x, int y, int z, int type) {
                 auto cellId = _cellStates.nextId();
                 _lattice.setPoint(cellId, x, y, z, 0, type);
-                _cellStates.addCell(1, 26, type);
-                _centroids.addCentroid({x,y,z}, 1);
-                nrOfCells++;
+                _cellStates.addCell(1, 26);
+                _centroids.addCentroid(cellId, {x,y,z}, 1);
+                _lastCellId = cellId;
             }
 
     private:
-        int nrOfCells;
+        int splitCell(int id, const std::vector<int>& voxels);
+        // Cell that updatePoint writes to.
+        int _lastCellId;
         L _lattice;
         CellStates<L> _cellStates;
         Centroids<L> _centroids;
         Hamiltonian<L> _hamiltonian;
+        ChemokineField _chemokine;
         Simulation<L> _simulation;
+        std::mt19937 _divisionRng;
         std::thread* _thread;
 };
 
@@ -29,3 +29,15 @@ int DiceSet::get(int index) {
 int DiceSet::size() {
     return _vector.size();
 }
+
+int DiceSet::position(int element) {
+    auto it = _map.find(element);
+    if (it == _map.end())
+        return -1;
+    return it->second;
+}
+
+void DiceSet::clear() {
+    _map.clear();
+    _vector.clear();
+}
@@ -10,7 +10,9 @@ class DiceSet {
         void add(int element);
         void remove(int element);
         int get(int index);
+        int position(int element);
         int size();
+        void clear();
         //std::unordered_map<int, int> _map;
         ska::bytell_hash_map<int, int> _map;
     private:
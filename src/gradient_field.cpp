@@ -0,0 +1,329 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "gradient_field.h"
+#include "sparse_memory.h"
+
+using namespace std;
+
+// IEEE half precision, as numpy's float16, rounding to nearest even.
+static uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int biased = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (biased == 0xff)
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    int exponent = biased - 127 + 15;
+    if (exponent >= 31)
+        return sign | 0x7c00;
+    if (exponent <= 0) {
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half++;
+        return sign | half;
+    }
+    uint32_t half = (exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return sign | half;
+}
+
+static float halfToFloat(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else {
+        float value = mantissa * (1.0f / 16777216.0f);
+        return sign ? -value : value;
+    }
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+GradientField::GradientField(int components, const int* dimensions,
+        const int* period):
+    _components(components), _storage(FieldStorage::float64),
+    _coarsening(1), _data(nullptr) {
+    for (int axis = 0; axis < 3; axis++) {
+        _dimensions[axis] = dimensions[axis];
+        _period[axis] = period[axis];
+    }
+    _size = (size_t)_dimensions[0] * _dimensions[1] * _dimensions[2];
+}
+
+GradientField::~GradientField() {
+    release();
+}
+
+// Converts what is stored to the new storage, so switching keeps the field
+// up to the precision of the new storage. Switching to analytic starts from
+// an empty list of sources.
+void GradientField::setStorage(FieldStorage storage, int coarsening) {
+    coarsening = storage == FieldStorage::coarse ? max(coarsening, 1) : 1;
+    if (storage == _storage && coarsening == _coarsening)
+        return;
+    vector<double> values;
+    bool keep = storage != FieldStorage::analytic &&
+        (_data || !_sources.empty());
+    if (keep) {
+        values.resize(_components * _size);
+        materialize(values.data());
+    }
+    release();
+    _sources.clear();
+    _storage = storage;
+    _coarsening = coarsening;
+    if (keep)
+        assign(values.data());
+}
+
+FieldStorage GradientField::getStorage() {
+    return _storage;
+}
+
+int GradientField::components() {
+    return _components;
+}
+
+int GradientField::dimension(int axis) {
+    return _dimensions[axis];
+}
+
+// Zero along walls.
+int GradientField::period(int axis) {
+    return _period[axis];
+}
+
+void GradientField::at(int x, int y, int z, double* vector) {
+    if (_storage == FieldStorage::analytic) {
+        analyticAt(x, y, z, vector);
+        return;
+    }
+    if (!_data) {
+        for (int c = 0; c < _components; c++)
+            vector[c] = 0;
+        return;
+    }
+    if (_storage == FieldStorage::coarse) {
+        coarseAt(x, y, z, vector);
+        return;
+    }
+    size_t i = ((size_t)z * _dimensions[1] + y) * _dimensions[0] + x;
+    for (int c = 0; c < _components; c++)
+        vector[c] = stored(c * _size + i);
+}
+
+// The stored values, allocating them if needed. For the per-voxel storages
+// these are laid out like the lattice, one component after the other.
+void* GradientField::data() {
+    if (!_data && storedCount() > 0)
+        _data = allocateSparse(storedBytes());
+    return _data;
+}
+
+// Writes the field at every voxel to values, laid out as by data().
+void GradientField::materialize(double* values) {
+    double vector[3];
+    size_t i = 0;
+    for (int z = 0; z < _dimensions[2]; z++) {
+        for (int y = 0; y < _dimensions[1]; y++) {
+            for (int x = 0; x < _dimensions[0]; x++, i++) {
+                at(x, y, z, vector);
+                for (int c = 0; c < _components; c++)
+                    values[c * _size + i] = vector[c];
+            }
+        }
+    }
+}
+
+// Stores a field laid out as by data(). A coarse grid takes the values at
+// its nodes, where nodes past the last voxel wrap around along periodic axes
+// and repeat the last voxel along walls. Analytic fields are defined by
+// their sources only.
+void GradientField::assign(const double* values) {
+    if (_storage == FieldStorage::analytic)
+        return;
+    data();
+    const size_t count = _components * _size;
+    if (_storage == FieldStorage::float64) {
+        copy(values, values + count, (double*)_data);
+        return;
+    }
+    if (_storage == FieldStorage::float32) {
+        copy(values, values + count, (float*)_data);
+        return;
+    }
+    if (_storage == FieldStorage::float16) {
+        for (size_t i = 0; i < count; i++)
+            store(i, values[i]);
+        return;
+    }
+    int counts[3] = {nodes(0), nodes(1), nodes(2)};
+    size_t node = 0;
+    for (int c = 0; c < _components; c++) {
+        for (int iz = 0; iz < counts[2]; iz++) {
+            for (int iy = 0; iy < counts[1]; iy++) {
+                for (int ix = 0; ix < counts[0]; ix++, node++) {
+                    int indices[3] = {ix, iy, iz};
+                    int p[3];
+                    for (int axis = 0; axis < 3; axis++) {
+                        p[axis] = indices[axis] * _coarsening;
+                        if (p[axis] >= _dimensions[axis])
+                            p[axis] = _period[axis] > 0 ?
+                                p[axis] % _period[axis] :
+                                _dimensions[axis] - 1;
+                    }
+                    size_t i = ((size_t)p[2] * _dimensions[1] + p[1]) *
+                        _dimensions[0] + p[0];
+                    store(node, values[c * _size + i]);
+                }
+            }
+        }
+    }
+}
+
+void GradientField::addSource(const double* position,
+        const double* direction, double strength, double decayLength) {
+    Source source;
+    source.line = direction != nullptr;
+    source.strength = strength;
+    source.decayLength = decayLength;
+    double length = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        source.position[axis] = axis < _components ? position[axis] : 0;
+        source.direction[axis] = source.line && axis < _components ?
+            direction[axis] : 0;
+        length += source.direction[axis] * source.direction[axis];
+    }
+    for (int axis = 0; axis < 3 && length > 0; axis++)
+        source.direction[axis] /= sqrt(length);
+    _sources.push_back(source);
+}
+
+void GradientField::clearSources() {
+    _sources.clear();
+}
+
+size_t GradientField::storedCount() {
+    if (_storage == FieldStorage::analytic)
+        return 0;
+    if (_storage == FieldStorage::coarse)
+        return (size_t)_components * nodes(0) * nodes(1) * nodes(2);
+    return _components * _size;
+}
+
+size_t GradientField::storedBytes() {
+    if (_storage == FieldStorage::float32)
+        return storedCount() * sizeof(float);
+    if (_storage == FieldStorage::float16)
+        return storedCount() * sizeof(uint16_t);
+    return storedCount() * sizeof(double);
+}
+
+void GradientField::release() {
+    if (_data)
+        freeSparse(_data, storedBytes());
+    _data = nullptr;
+}
+
+// Nodes of the coarse grid along an axis, enough for every voxel to have
+// one on either side.
+int GradientField::nodes(int axis) {
+    if (_dimensions[axis] == 1)
+        return 1;
+    return (_dimensions[axis] - 1) / _coarsening + 2;
+}
+
+double GradientField::stored(size_t i) {
+    if (_storage == FieldStorage::float32)
+        return ((float*)_data)[i];
+    if (_storage == FieldStorage::float16)
+        return halfToFloat(((uint16_t*)_data)[i]);
+    return ((double*)_data)[i];
+}
+
+void GradientField::store(size_t i, double value) {
+    if (_storage == FieldStorage::float32)
+        ((float*)_data)[i] = value;
+    else if (_storage == FieldStorage::float16)
+        ((uint16_t*)_data)[i] = floatToHalf(value);
+    else
+        ((double*)_data)[i] = value;
+}
+
+// Trilinear interpolation between the eight surrounding nodes.
+void GradientField::coarseAt(int x, int y, int z, double* vector) {
+    const int p[3] = {x, y, z};
+    const int counts[3] = {nodes(0), nodes(1), nodes(2)};
+    int lower[3];
+    int upper[3];
+    double weights[3];
+    for (int axis = 0; axis < 3; axis++) {
+        lower[axis] = p[axis] / _coarsening;
+        upper[axis] = min(lower[axis] + 1, counts[axis] - 1);
+        weights[axis] = (p[axis] % _coarsening) / (double)_coarsening;
+    }
+    const double* values = (const double*)_data;
+    const size_t nodeCount = (size_t)counts[0] * counts[1] * counts[2];
+    for (int c = 0; c < _components; c++) {
+        double value = 0;
+        for (int corner = 0; corner < 8; corner++) {
+            double weight = 1;
+            int indices[3];
+            for (int axis = 0; axis < 3; axis++) {
+                bool high = (corner >> axis) & 1;
+                indices[axis] = high ? upper[axis] : lower[axis];
+                weight *= high ? weights[axis] : 1 - weights[axis];
+            }
+            size_t node = ((size_t)indices[2] * counts[1] + indices[1]) *
+                counts[0] + indices[0];
+            value += weight * values[c * nodeCount + node];
+        }
+        vector[c] = value;
+    }
+}
+
+// Sum of the concentration gradients of all sources, each taken from its
+// nearest periodic image.
+void GradientField::analyticAt(int x, int y, int z, double* vector) {
+    for (int c = 0; c < _components; c++)
+        vector[c] = 0;
+    const double p[3] = {double(x), double(y), double(z)};
+    for (auto& source: _sources) {
+        double r[3];
+        for (int axis = 0; axis < 3; axis++) {
+            r[axis] = p[axis] - source.position[axis];
+            if (_period[axis] > 0)
+                r[axis] -= _period[axis] * round(r[axis] / _period[axis]);
+        }
+        if (source.line) {
+            double along = r[0] * source.direction[0] +
+                r[1] * source.direction[1] + r[2] * source.direction[2];
+            for (int axis = 0; axis < 3; axis++)
+                r[axis] -= along * source.direction[axis];
+        }
+        double distance = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+        if (distance == 0)
+            continue;
+        double slope = source.strength / source.decayLength *
+            exp(-distance / source.decayLength);
+        for (int c = 0; c < _components; c++)
+            vector[c] -= slope * r[c] / distance;
+    }
+}
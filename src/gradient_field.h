@@ -0,0 +1,68 @@
+#ifndef GRADIENT_FIELD_H_
+#define GRADIENT_FIELD_H_
+
+#include <vector>
+#include <cstddef>
+
+// float64, float32 and float16 store one vector per voxel. coarse stores
+// doubles every coarsening voxels along each axis and interpolates between
+// them. analytic stores nothing and sums the gradients of point and line
+// sources instead.
+enum class FieldStorage {
+    float64,
+    float32,
+    float16,
+    coarse,
+    analytic
+};
+
+// The vector field chemotaxis follows, with components() values per voxel.
+// Stored values are only allocated once they are written or handed out, and
+// read as zero until then. 2D lattices use a depth of one.
+class GradientField {
+    public:
+        GradientField(int components, const int* dimensions,
+                const int* period);
+        ~GradientField();
+        void setStorage(FieldStorage storage, int coarsening);
+        FieldStorage getStorage();
+        int components();
+        int dimension(int axis);
+        int period(int axis);
+        int nodes(int axis);
+        void at(int x, int y, int z, double* vector);
+        void* data();
+        void materialize(double* values);
+        void assign(const double* values);
+        void addSource(const double* position, const double* direction,
+                double strength, double decayLength);
+        void clearSources();
+    private:
+        // The concentration around a source falls off as
+        // strength * exp(-distance / decayLength). Line sources run through
+        // position along direction, which is a unit vector.
+        struct Source {
+            double position[3];
+            double direction[3];
+            bool line;
+            double strength;
+            double decayLength;
+        };
+        size_t storedCount();
+        size_t storedBytes();
+        void release();
+        double stored(size_t i);
+        void store(size_t i, double value);
+        void coarseAt(int x, int y, int z, double* vector);
+        void analyticAt(int x, int y, int z, double* vector);
+        const int _components;
+        int _dimensions[3];
+        int _period[3];
+        size_t _size;
+        FieldStorage _storage;
+        int _coarsening;
+        void* _data;
+        std::vector<Source> _sources;
+};
+
+#endif // GRADIENT_FIELD_H_
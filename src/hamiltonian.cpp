@@ -4,12 +4,18 @@
 #include "lattice.h"
 #include "cell_states.h"
 #include "centroids.h"
+#include "neighbor_kernels.h"
+#include "local_connectivity.h"
 
 using namespace std;
 
+// Integral energy deltas below this get their Boltzmann factor from a table.
+static const int defaultBoltzmannTableSize = 256;
+
 template <typename L>
 Hamiltonian<L>::Hamiltonian(int numberOfTypes, double temperature): 
-    _numberOfTypes(numberOfTypes), _temperature(temperature) {
+    _numberOfTypes(numberOfTypes), _temperature(temperature), 
+    _kernels(neighborKernels()), _connectivity(localConnectivity<L>()) {
     _adhesionMatrix = new int[numberOfTypes * numberOfTypes]();
     _areaLambdas = new double[numberOfTypes]();
     _areaTargets = new double[numberOfTypes]();
@@ -21,6 +27,8 @@ Hamiltonian<L>::Hamiltonian(int numberOfTypes, double temperature):
     _chemotaxisLambdas = new double[numberOfTypes]();
     _fixedCelltype = new bool[numberOfTypes]();
     _persistenceLambdas = new double[numberOfTypes]();
+    setBoltzmannTable(defaultBoltzmannTableSize);
+    updateConstraintToggles();
 }
 
 template <typename L>
@@ -43,6 +51,48 @@ void Hamiltonian<L>::setFixedCelltype(int type, bool fixed) {
     _fixedCelltype[type] = fixed;
 }
 
+template <typename L>
+void Hamiltonian<L>::attachTerms(L& lattice, CellStates<L>& cellStates,
+        Centroids<L>& centroids, const int& time) {
+    apply([&](auto&... term) {
+        (term.attach(_numberOfTypes, lattice, cellStates, centroids, time), 
+         ...);
+    }, _terms);
+}
+
+template <typename L>
+bool Hamiltonian<L>::hasTermParameter(const char* name) {
+    return apply([&](auto&... term) {
+        return (false || ... || term.hasParameter(name));
+    }, _terms);
+}
+
+template <typename L>
+bool Hamiltonian<L>::setTermParameter(int type, const char* name, 
+        double value) {
+    return apply([&](auto&... term) {
+        return (false || ... || term.setParameter(type, name, value));
+    }, _terms);
+}
+
+template <typename L>
+double Hamiltonian<L>::registeredDelta(LatticePoint& source, 
+        LatticePoint& target, Neighborhood& neighbors) {
+    return apply([&](auto&... term) {
+        return (0.0 + ... + 
+                (term.enabled() ? term.delta(source, target, neighbors) : 0));
+    }, _terms);
+}
+
+template <typename L>
+void Hamiltonian<L>::onAccept(LatticePoint& source, LatticePoint& target) {
+    if (!_registeredEnabled)
+        return;
+    apply([&](auto&... term) {
+        ((term.enabled() ? term.onAccept(source, target) : void()), ...);
+    }, _terms);
+}
+
 template <typename L>
 void Hamiltonian<L>::setPersistence(int type, double lambda) {
     _persistenceLambdas[type] = lambda;
@@ -92,19 +142,36 @@ int Hamiltonian<L>::getAdhesionBetween(LatticePoint& a, LatticePoint& b) {
     return _adhesionMatrix[b.type * _numberOfTypes + a.type];
 }
 
+// With the neighbour type counts kept by the lattice, only neighbours of
+// the source and target cells need to be told apart, and the rest is a sum
+// over types.
 template <typename L>
 int Hamiltonian<L>::adhesionDelta(LatticePoint& source, LatticePoint& target, 
-        L& lattice) {
-    int previousAdhesion = 0;
-    int nextAdhesion = 0;
-    for (int i = 0; i < lattice.getNeighborCount(); i++) {
-        LatticePoint neighbor = lattice.getNeighbor(target, i);
-        if (neighbor.cellId != target.cellId)
-            previousAdhesion += getAdhesionBetween(target, neighbor);
-        if (neighbor.cellId != source.cellId)
-            nextAdhesion += getAdhesionBetween(source, neighbor);
+        Neighborhood& neighbors, L& lattice) {
+    const unsigned char* typeCounts = lattice.getTypeCounts(target);
+    if (typeCounts) {
+        const int* sourceColumn = &_adhesionMatrix[source.type];
+        const int* targetColumn = &_adhesionMatrix[target.type];
+        int sourceMatches, targetMatches;
+        _kernels.countMatches(neighbors.cellIds, L::neighborCount, 
+                source.cellId, target.cellId, &sourceMatches, &targetMatches);
+        int mediumCount = L::neighborCount;
+        int delta = 0;
+        for (int type = 1; type < _numberOfTypes; type++) {
+            int count = typeCounts[type - 1];
+            mediumCount -= count;
+            delta += count * (sourceColumn[type * _numberOfTypes] - 
+                    targetColumn[type * _numberOfTypes]);
+        }
+        delta += mediumCount * (sourceColumn[0] - targetColumn[0]);
+        return delta - sourceMatches * 
+            sourceColumn[source.type * _numberOfTypes] + targetMatches * 
+            targetColumn[target.type * _numberOfTypes];
     }
-    return nextAdhesion - previousAdhesion;
+    return _kernels.adhesionDelta(neighbors.cellIds, neighbors.types, 
+            L::neighborCount, source.cellId, target.cellId, 
+            &_adhesionMatrix[source.type], &_adhesionMatrix[target.type], 
+            _numberOfTypes);
 }
 
 template <typename L>
@@ -132,26 +199,15 @@ double Hamiltonian<L>::areasDelta(LatticePoint& source, LatticePoint& target,
 
 template <typename L>
 double Hamiltonian<L>::perimeterDelta(LatticePoint& source, LatticePoint& target, 
-        L& lattice, CellStates<L>& cellStates) {
+        Neighborhood& neighbors, CellStates<L>& cellStates) {
     double delta = 0;
 
-    int oldPerimeterSource = 0;
-    int newPerimeterSource = 0;
-
-    int oldPerimeterTarget = 0;
-    int newPerimeterTarget = 0;
-
-    for (int i = 0; i < lattice.getNeighborCount(); i++) {
-        LatticePoint neighbor = lattice.getNeighbor(target, i);
-        if (neighbor.cellId == source.cellId)
-            oldPerimeterSource++;
-        if (neighbor.cellId != source.cellId)
-            newPerimeterSource++;
-        if (neighbor.cellId != target.cellId)
-            oldPerimeterTarget++;
-        if (neighbor.cellId == target.cellId)
-            newPerimeterTarget++;
-    }
+    int oldPerimeterSource;
+    int newPerimeterTarget;
+    _kernels.countMatches(neighbors.cellIds, L::neighborCount, source.cellId,
+            target.cellId, &oldPerimeterSource, &newPerimeterTarget);
+    int newPerimeterSource = L::neighborCount - oldPerimeterSource;
+    int oldPerimeterTarget = L::neighborCount - newPerimeterTarget;
 
     if (source.cellId != 0) {
         int currentPerimeter = cellStates.getPerimeter(source.cellId);
@@ -180,7 +236,7 @@ double Hamiltonian<L>::perimeterDelta(LatticePoint& source, LatticePoint& target
 
 template <typename L>
 double Hamiltonian<L>::actDelta(LatticePoint& source, LatticePoint& target, 
-        L& lattice, int time) {
+        Neighborhood& neighbors, L& lattice, int time) {
 
     auto lambda = _actLambdas[source.type];
     auto maxAct = _actMaxima[source.type];
@@ -193,41 +249,18 @@ double Hamiltonian<L>::actDelta(LatticePoint& source, LatticePoint& target,
         return 0;
 
 
-    double sourceAct = max(_actMaxima[source.type]+source.act-time, 0.0);
+    double sourceAct = 0;
     if (source.cellId != 0) {
-        const auto maxAct = _actMaxima[source.type];
-        int count = 1;
-        for (int i = 0; i < lattice.getNeighborCount(); i++) {
-            auto neighbor = lattice.getNeighbor(source, i);
-            if (neighbor.cellId == source.cellId) {
-                auto act = max(maxAct+neighbor.act-time, 0.0);
-                sourceAct *= act;
-                count++;
-            }
-        }
-        sourceAct = pow(sourceAct, 1.0/count);
-
-    } else {
-        sourceAct = 0;
+        Neighborhood sourceNeighbors;
+        lattice.getNeighborhood(source, sourceNeighbors);
+        sourceAct = actProduct(source.cellId, source.type, 
+                lattice.getAct(source), sourceNeighbors, time);
     }
 
-
-    double targetAct = max(_actMaxima[target.type]+target.act-time, 0.0);
-    if (target.cellId != 0) {
-        const auto maxAct = _actMaxima[target.type];
-        int count = 1;
-        for (int i = 0; i < lattice.getNeighborCount(); i++) {
-            auto neighbor = lattice.getNeighbor(target, i);
-            if (neighbor.cellId == target.cellId) {
-                auto act = max(maxAct+neighbor.act-time, 0.0);
-                targetAct *= act;
-                count++;
-            }
-        }
-        targetAct = pow(targetAct, 1.0/count);
-    } else {
-        targetAct = 0;
-    }
+    double targetAct = 0;
+    if (target.cellId != 0)
+        targetAct = actProduct(target.cellId, target.type, 
+                lattice.getAct(target), neighbors, time);
 
 
     if (maxAct == 0)
@@ -237,6 +270,42 @@ double Hamiltonian<L>::actDelta(LatticePoint& source, LatticePoint& target,
 
 }
 
+// Smallest value actDelta can take for this pair of voxels. Each geometric
+// mean lies between 0 and the maximum act of its own cell's type, as acts
+// are never later than the current time, but both are scaled by the
+// maximum of the type whose lambda applies. With a positive lambda the
+// source mean lowers the energy, with a negative one the target mean.
+template <typename L>
+double Hamiltonian<L>::actLowerBound(LatticePoint& source, 
+        LatticePoint& target) {
+    int type = source.type == 0 ? target.type : source.type;
+    auto lambda = _actLambdas[type];
+    auto maxAct = _actMaxima[type];
+    if (lambda == 0 || maxAct == 0)
+        return 0;
+    auto& lowering = lambda > 0 ? source : target;
+    if (lowering.cellId == 0)
+        return 0;
+    return -fabs(lambda/maxAct * _actMaxima[lowering.type]);
+}
+
+// Geometric mean of the act values of a voxel and its neighbours in the
+// same cell.
+template <typename L>
+double Hamiltonian<L>::actProduct(unsigned int cellId, int type, int act,
+        Neighborhood& neighbors, int time) {
+    const auto maxAct = _actMaxima[type];
+    double product = max(maxAct+act-time, 0.0);
+    int count = 1;
+    for (int i = 0; i < L::neighborCount; i++) {
+        if (neighbors.cellIds[i] == cellId) {
+            product *= max(maxAct+neighbors.acts[i]-time, 0.0);
+            count++;
+        }
+    }
+    return pow(product, 1.0/count);
+}
+
 template <typename L>
 double Hamiltonian<L>::persistenceDelta(LatticePoint& source, LatticePoint& target,
         L& lattice, Centroids<L>& centroids) {
@@ -244,7 +313,7 @@ double Hamiltonian<L>::persistenceDelta(LatticePoint& source, LatticePoint& targ
         return 0;
 
     auto currentDir = target.subtract(source);
-    currentDir = currentDir.wrap(lattice._dimension);
+    currentDir = currentDir.wrap(lattice.period());
     currentDir = currentDir.normalize();
     return -currentDir.dot(centroids.getPrefDir(source.cellId)) * _persistenceLambdas[source.type];
 
@@ -253,19 +322,13 @@ double Hamiltonian<L>::persistenceDelta(LatticePoint& source, LatticePoint& targ
 
 template <typename L>
 double Hamiltonian<L>::connectedDelta(LatticePoint& source, LatticePoint& target,
-        L& lattice) {
+        Neighborhood& neighbors) {
     if  (_connectedLambdas[target.type] == 0)
         return 0;
-    int transitions = 0;
-    for (int i = 0; i < lattice.getNeighborCount(); i++) {
-        auto prev = lattice.getNeighbor(target, (i+lattice.getNeighborCount()-1) % lattice.getNeighborCount());
-        auto current = lattice.getNeighbor(target, i);
-        if ((prev.cellId != target.cellId && current.cellId == target.cellId) ||
-            (prev.cellId == target.cellId && current.cellId != target.cellId)) {
-            transitions++;
-        }
-    }
-    if (transitions < 3)
+    uint32_t pattern = 0;
+    for (int i = 0; i < L::neighborCount; i++)
+        pattern |= uint32_t(neighbors.cellIds[i] == target.cellId) << i;
+    if (_connectivity.isSimple(pattern))
         return 0;
     else {
         return _connectedLambdas[target.type];
@@ -296,8 +359,8 @@ double Hamiltonian<L>::directionDelta(LatticePoint& source, LatticePoint& target
     v = v.normalize();
 
     vec2 c;
-    c.y =  - (lattice._dimension/2 - source.x);
-    c.x =  lattice._dimension/2 - source.y;
+    c.y =  - (lattice._dimensions.x/2 - source.x);
+    c.x =  lattice._dimensions.y/2 - source.y;
     c = c.normalize();
 
     return -c.dot(v) * 10;
@@ -307,35 +370,182 @@ template <typename L>
 double Hamiltonian<L>::energyDelta(LatticePoint& source, LatticePoint& target, 
         L& lattice, CellStates<L>& cellStates, Centroids<L>& centroids,
         ChemokineField* field, int time) {
+    Neighborhood neighbors;
+    lattice.getNeighborhood(target, neighbors);
+    return energyDelta(source, target, neighbors, lattice, cellStates, 
+            centroids, field, time);
+}
+
+// Evaluates all enabled terms from one gathered neighbourhood of the
+// target, which callers can reuse for updatePerimeters once the copy is
+// accepted.
+template <typename L>
+double Hamiltonian<L>::energyDelta(LatticePoint& source, LatticePoint& target, 
+        Neighborhood& neighbors, L& lattice, CellStates<L>& cellStates, 
+        Centroids<L>& centroids, ChemokineField* field, int time) {
+    return (this->*_energyKernel)(source, target, neighbors, lattice, 
+            cellStates, centroids, time);
+}
+
+template <typename L>
+template <int Terms>
+double Hamiltonian<L>::energyDeltaOf(LatticePoint& source, 
+        LatticePoint& target, Neighborhood& neighbors, L& lattice, 
+        CellStates<L>& cellStates, Centroids<L>& centroids, int time) {
     double energyDelta = 0;
 
     energyDelta += areasDelta(source, target, cellStates);
-    energyDelta += adhesionDelta(source, target, lattice);
+    energyDelta += adhesionDelta(source, target, neighbors, lattice);
     //energyDelta += directionDelta(source, target, lattice);
-    if(_perimeterEnabled)
-        energyDelta += perimeterDelta(source, target, lattice, cellStates);
-    if(_actEnabled)
-        energyDelta += actDelta(source, target, lattice, time);
-    if(_connectedEnabled)
-        energyDelta += connectedDelta(source, target, lattice);
-    if(_persistenceEnabled)
+    if constexpr ((Terms & perimeterTerm) != 0)
+        energyDelta += perimeterDelta(source, target, neighbors, cellStates);
+    if constexpr ((Terms & actTerm) != 0)
+        energyDelta += actDelta(source, target, neighbors, lattice, time);
+    if constexpr ((Terms & connectedTerm) != 0)
+        energyDelta += connectedDelta(source, target, neighbors);
+    if constexpr ((Terms & persistenceTerm) != 0)
         energyDelta += persistenceDelta(source, target, lattice, centroids);
-    //if (field)
-    if(_chemotaxisEnabled) 
+    if constexpr ((Terms & chemotaxisTerm) != 0)
         energyDelta += chemotaxisDelta(source, target, lattice);
+    if constexpr ((Terms & registeredTerms) != 0)
+        energyDelta += registeredDelta(source, target, neighbors);
     return energyDelta;
 }
 
+template <typename L>
+bool Hamiltonian<L>::acceptsCopy(LatticePoint& source, LatticePoint& target,
+        Neighborhood& neighbors, L& lattice, CellStates<L>& cellStates,
+        Centroids<L>& centroids, int time, double threshold) {
+    return (this->*_acceptanceKernel)(source, target, neighbors, lattice, 
+            cellStates, centroids, time, threshold);
+}
+
+// Whether a copy lowers the energy by less than threshold, i.e. whether it
+// passes a Metropolis test whose uniform draw was turned into the threshold
+// -temperature * log(u) beforehand. Terms go cheapest first, and the copy
+// is rejected as soon as the terms left cannot bring the delta below the
+// threshold any more: connectedness adds at least min(lambda, 0), and act
+// at least actLowerBound.
+template <typename L>
+template <int Terms>
+bool Hamiltonian<L>::acceptsCopyOf(LatticePoint& source, 
+        LatticePoint& target, Neighborhood& neighbors, L& lattice, 
+        CellStates<L>& cellStates, Centroids<L>& centroids, int time, 
+        double threshold) {
+    double energyDelta = areasDelta(source, target, cellStates);
+    energyDelta += adhesionDelta(source, target, neighbors, lattice);
+    if constexpr ((Terms & perimeterTerm) != 0)
+        energyDelta += perimeterDelta(source, target, neighbors, cellStates);
+    if constexpr ((Terms & chemotaxisTerm) != 0)
+        energyDelta += chemotaxisDelta(source, target, lattice);
+    if constexpr ((Terms & persistenceTerm) != 0)
+        energyDelta += persistenceDelta(source, target, lattice, centroids);
+    if constexpr ((Terms & registeredTerms) != 0)
+        energyDelta += registeredDelta(source, target, neighbors);
+    double actBound = 0;
+    if constexpr ((Terms & actTerm) != 0)
+        actBound = actLowerBound(source, target);
+    if constexpr ((Terms & connectedTerm) != 0) {
+        double connectedBound = min(_connectedLambdas[target.type], 0.0);
+        if (energyDelta + connectedBound + actBound >= threshold)
+            return false;
+        energyDelta += connectedDelta(source, target, neighbors);
+    }
+    if constexpr ((Terms & actTerm) != 0) {
+        if (energyDelta + actBound >= threshold)
+            return false;
+        energyDelta += actDelta(source, target, neighbors, lattice, time);
+    }
+    return energyDelta < threshold;
+}
+
+// Instantiates the kernels for every mask and picks those of the enabled
+// terms.
+template <typename L>
+template <int... Masks>
+void Hamiltonian<L>::selectKernels(integer_sequence<int, Masks...>) {
+    static const EnergyKernel energyKernels[] = {
+        &Hamiltonian::energyDeltaOf<Masks>...
+    };
+    static const AcceptanceKernel acceptanceKernels[] = {
+        &Hamiltonian::acceptsCopyOf<Masks>...
+    };
+    _energyKernel = energyKernels[_enabledTerms];
+    _acceptanceKernel = acceptanceKernels[_enabledTerms];
+}
+
+// The entries are computed exactly as boltzmannProbability would, so the
+// table does not change any acceptance. A size of zero disables it.
+template <typename L>
+void Hamiltonian<L>::setBoltzmannTable(int size) {
+    _boltzmannTable.resize(max(size, 0));
+    for (size_t delta = 0; delta < _boltzmannTable.size(); delta++)
+        _boltzmannTable[delta] = exp(-double(delta)/_temperature);
+}
+
 template <typename L>
 double Hamiltonian<L>::boltzmannProbability(double energyDelta) {
+    if (energyDelta >= 0 && energyDelta < _boltzmannTable.size()) {
+        int delta = energyDelta;
+        if (delta == energyDelta)
+            return _boltzmannTable[delta];
+    }
     return exp(-energyDelta/_temperature);
+}
 
+template <typename L>
+double Hamiltonian<L>::getTemperature() {
+    return _temperature;
 }
+
+template <typename L>
+int Hamiltonian<L>::getEnabledTerms() {
+    return _enabledTerms;
+}
+
+template <typename L>
+typename Hamiltonian<L>::EnergyKernel Hamiltonian<L>::getEnergyKernel() {
+    return _energyKernel;
+}
+
+template <typename L>
+typename Hamiltonian<L>::AcceptanceKernel 
+Hamiltonian<L>::getAcceptanceKernel() {
+    return _acceptanceKernel;
+}
+
+template <typename L>
+int Hamiltonian<L>::getNumberOfTypes() {
+    return _numberOfTypes;
+}
+
 template <typename L>
 bool Hamiltonian<L>::getActEnabled() {
     return _actEnabled;
 }
 
+template <typename L>
+bool Hamiltonian<L>::getChemotaxisEnabled() {
+    return _chemotaxisEnabled;
+}
+
+// Act and persistence energies change from one Monte Carlo step to the
+// next even when the lattice does not, and registered terms may.
+template <typename L>
+bool Hamiltonian<L>::getTimeDependent() {
+    return _actEnabled || _persistenceEnabled || _registeredEnabled;
+}
+
+// Whether copies involving a cell of this type depend on the cell's area or
+// perimeter, and not just on its neighbourhood. Registered terms may depend
+// on anything about the cell.
+template <typename L>
+bool Hamiltonian<L>::getCellTotalsUsed(int type) {
+    return _areaLambdas[type] != 0 || 
+        (_perimeterEnabled && _perimeterLambdas[type] != 0) ||
+        _registeredEnabled;
+}
+
 template <typename L>
 void Hamiltonian<L>::updateConstraintToggles() {
     _perimeterEnabled = false;
@@ -350,6 +560,16 @@ void Hamiltonian<L>::updateConstraintToggles() {
         if (_persistenceLambdas[i] != 0) _persistenceEnabled = true;
         if (_connectedLambdas[i] != 0) _connectedEnabled = true;
     }
+    _registeredEnabled = apply([](auto&... term) {
+        return (false || ... || term.enabled());
+    }, _terms);
+    _enabledTerms = (_perimeterEnabled ? perimeterTerm : 0) |
+        (_actEnabled ? actTerm : 0) |
+        (_connectedEnabled ? connectedTerm : 0) |
+        (_persistenceEnabled ? persistenceTerm : 0) |
+        (_chemotaxisEnabled ? chemotaxisTerm : 0) |
+        (_registeredEnabled ? registeredTerms : 0);
+    selectKernels(make_integer_sequence<int, energyTermMasks>());
 
 }
 
@@ -1,15 +1,43 @@
 #ifndef HAMILTONIAN_H_
 #define HAMILTONIAN_H_
 
+#include <vector>
+#include <utility>
+#include "hamiltonian_term.h"
+
 template <typename L> class CellStates;
 class ChemokineField;
 template <typename L> class Centroids;
+struct NeighborKernels;
+class LocalConnectivity;
 
+// Terms that can be switched off, as the bits of the mask energy kernels are
+// specialised on. Area and adhesion are always evaluated. registeredTerms
+// stands for all terms registered through hamiltonian_term.h.
+enum EnergyTerm {
+    perimeterTerm = 1,
+    actTerm = 2,
+    connectedTerm = 4,
+    persistenceTerm = 8,
+    chemotaxisTerm = 16,
+    registeredTerms = 32,
+    energyTermMasks = 64
+};
 
 template <typename L>
 class Hamiltonian {
     public:
         typedef typename L::LatticePoint LatticePoint;
+        typedef typename L::Neighborhood Neighborhood;
+        // energyDelta and acceptsCopy with only the enabled terms compiled
+        // in, picked by updateConstraintToggles.
+        typedef double (Hamiltonian::*EnergyKernel)(LatticePoint& source,
+                LatticePoint& target, Neighborhood& neighbors, L& lattice,
+                CellStates<L>& cellStates, Centroids<L>& centroids, int time);
+        typedef bool (Hamiltonian::*AcceptanceKernel)(LatticePoint& source,
+                LatticePoint& target, Neighborhood& neighbors, L& lattice,
+                CellStates<L>& cellStates, Centroids<L>& centroids, int time,
+                double threshold);
         Hamiltonian(int types, double temperature);
         ~Hamiltonian();
         void setAdhesionBetweenTypes(int typeA, int typeB, int type);
@@ -19,6 +47,11 @@ class Hamiltonian {
         void setConnectedConstraints(int type, double lambda);
         void setChemotaxisConstraints(int type, double lambda);
         void setFixedCelltype(int type, bool fixed);
+        void attachTerms(L& lattice, CellStates<L>& cellStates,
+                Centroids<L>& centroids, const int& time);
+        bool hasTermParameter(const char* name);
+        bool setTermParameter(int type, const char* name, double value);
+        void onAccept(LatticePoint& source, LatticePoint& target);
         void setPersistence(int type, double lambda);
         int getAdhesionBetween(LatticePoint& a, LatticePoint& b);
         bool getFixedCelltype(int type);
@@ -26,15 +59,15 @@ class Hamiltonian {
         double persistenceDelta(LatticePoint& source, LatticePoint& target,
                 L& lattice, Centroids<L>& centroids);
         int adhesionDelta(LatticePoint& source, LatticePoint& target, 
-                L& lattice);
+                Neighborhood& neighbors, L& lattice);
         double areasDelta(LatticePoint& source, LatticePoint& target, 
                 CellStates<L>& cellStates);
         double perimeterDelta(LatticePoint& source, LatticePoint& target, 
-                L& lattice, CellStates<L>& cellStates);
+                Neighborhood& neighbors, CellStates<L>& cellStates);
         double actDelta(LatticePoint& source, LatticePoint& target, 
-                L& lattice, int time);
+                Neighborhood& neighbors, L& lattice, int time);
         double connectedDelta(LatticePoint& source, LatticePoint& target,
-                L& lattice);
+                Neighborhood& neighbors);
         double chemotaxisDelta(LatticePoint& source, LatticePoint& target,
                 L& lattice);
         double directionDelta(LatticePoint& source, LatticePoint& target, 
@@ -42,10 +75,40 @@ class Hamiltonian {
         double energyDelta(LatticePoint& source, LatticePoint& target, 
                 L& lattice, CellStates<L>& cellStates, Centroids<L>& centroids,
                 ChemokineField* field, int time);
+        double energyDelta(LatticePoint& source, LatticePoint& target, 
+                Neighborhood& neighbors, L& lattice, CellStates<L>& cellStates,
+                Centroids<L>& centroids, ChemokineField* field, int time);
+        bool acceptsCopy(LatticePoint& source, LatticePoint& target, 
+                Neighborhood& neighbors, L& lattice, CellStates<L>& cellStates,
+                Centroids<L>& centroids, int time, double threshold);
+        void setBoltzmannTable(int size);
         double boltzmannProbability(double energyDelta);
+        double getTemperature();
+        int getEnabledTerms();
+        EnergyKernel getEnergyKernel();
+        AcceptanceKernel getAcceptanceKernel();
+        int getNumberOfTypes();
         bool getActEnabled();
+        bool getChemotaxisEnabled();
+        bool getTimeDependent();
+        bool getCellTotalsUsed(int type);
     private:
+        template <int Terms>
+        double energyDeltaOf(LatticePoint& source, LatticePoint& target, 
+                Neighborhood& neighbors, L& lattice, CellStates<L>& cellStates,
+                Centroids<L>& centroids, int time);
+        template <int Terms>
+        bool acceptsCopyOf(LatticePoint& source, LatticePoint& target, 
+                Neighborhood& neighbors, L& lattice, CellStates<L>& cellStates,
+                Centroids<L>& centroids, int time, double threshold);
+        double registeredDelta(LatticePoint& source, LatticePoint& target,
+                Neighborhood& neighbors);
+        template <int... Masks>
+        void selectKernels(std::integer_sequence<int, Masks...>);
         double energyAreaDelta(int area, int newArea, LatticePoint& point);
+        double actProduct(unsigned int cellId, int type, int act,
+                Neighborhood& neighbors, int time);
+        double actLowerBound(LatticePoint& source, LatticePoint& target);
         int* _adhesionMatrix;
         double* _areaLambdas;
         double* _areaTargets;
@@ -59,12 +122,22 @@ class Hamiltonian {
         double* _persistenceLambdas;
         int _numberOfTypes;
         double _temperature;
+        // exp(-delta / temperature) for the integral deltas below its size.
+        std::vector<double> _boltzmannTable;
 
         bool _perimeterEnabled;
         bool _actEnabled;
         bool _chemotaxisEnabled;
         bool _persistenceEnabled;
         bool _connectedEnabled;
+        bool _registeredEnabled;
+        int _enabledTerms;
+        EnergyKernel _energyKernel;
+        AcceptanceKernel _acceptanceKernel;
+
+        const NeighborKernels& _kernels;
+        LocalConnectivity& _connectivity;
+        typename RegisteredTerms::template Tuple<L> _terms;
 };
 
 #endif // HAMILTONIAN_H_
@@ -0,0 +1,120 @@
+#ifndef HAMILTONIAN_TERM_H_
+#define HAMILTONIAN_TERM_H_
+
+#include <tuple>
+#include <vector>
+#include <cstring>
+#include <iterator>
+
+template <typename L> class CellStates;
+template <typename L> class Centroids;
+
+// Base of energy terms that are compiled into the Hamiltonian next to the
+// built-in ones. A term is a class template over the lattice that derives
+// from HamiltonianTerm<Term<L>, L>, names its per-type parameters, which
+// set_constraints accepts as keywords, and computes its energy change:
+//
+//     template <typename L>
+//     class Elongation: public HamiltonianTerm<Elongation<L>, L> {
+//         public:
+//             typedef typename L::LatticePoint LatticePoint;
+//             typedef typename L::Neighborhood Neighborhood;
+//             static constexpr const char* parameterNames[] = {
+//                 "lambda_elongation", "target_elongation"};
+//             double delta(LatticePoint& source, LatticePoint& target,
+//                     Neighborhood& neighbors);
+//     };
+//
+// Inside the term, this->parameter(i, type) reads the i-th parameter, and
+// this->lattice(), cellStates(), centroids() and time() the simulation.
+// onAccept is called after every copy the engines perform, one at a time,
+// for terms that keep state of their own. A term is only evaluated while
+// one of its parameters is non-zero for some type, and the Hamiltonian
+// then treats every energy as time dependent and as depending on cell
+// totals.
+template <typename Derived, typename L>
+class HamiltonianTerm {
+    public:
+        typedef typename L::LatticePoint LatticePoint;
+        typedef typename L::Neighborhood Neighborhood;
+
+        void attach(int numberOfTypes, L& lattice, CellStates<L>& cellStates,
+                Centroids<L>& centroids, const int& time) {
+            _numberOfTypes = numberOfTypes;
+            _parameters.assign(parameterCount() * numberOfTypes, 0.0);
+            _lattice = &lattice;
+            _cellStates = &cellStates;
+            _centroids = &centroids;
+            _time = &time;
+        }
+
+        static bool hasParameter(const char* name) {
+            return index(name) >= 0;
+        }
+
+        bool setParameter(int type, const char* name, double value) {
+            int i = index(name);
+            if (i < 0)
+                return false;
+            _parameters[i * _numberOfTypes + type] = value;
+            return true;
+        }
+
+        bool enabled() {
+            for (auto parameter: _parameters) {
+                if (parameter != 0)
+                    return true;
+            }
+            return false;
+        }
+
+        void onAccept(LatticePoint&, LatticePoint&) {}
+
+    protected:
+        double parameter(int i, int type) {
+            return _parameters[i * _numberOfTypes + type];
+        }
+        L& lattice() { return *_lattice; }
+        CellStates<L>& cellStates() { return *_cellStates; }
+        Centroids<L>& centroids() { return *_centroids; }
+        int time() { return *_time; }
+
+    private:
+        static constexpr int parameterCount() {
+            return std::size(Derived::parameterNames);
+        }
+        static int index(const char* name) {
+            for (int i = 0; i < parameterCount(); i++) {
+                if (strcmp(Derived::parameterNames[i], name) == 0)
+                    return i;
+            }
+            return -1;
+        }
+        int _numberOfTypes = 0;
+        std::vector<double> _parameters;
+        L* _lattice = nullptr;
+        CellStates<L>* _cellStates = nullptr;
+        Centroids<L>* _centroids = nullptr;
+        const int* _time = nullptr;
+};
+
+template <template <typename> class... Terms>
+struct TermList {
+    template <typename L>
+    using Tuple = std::tuple<Terms<L>...>;
+};
+
+// Terms are registered at build time: setup.py passes the header named by
+// the CPM_TERMS_HEADER environment variable, which defines the terms and
+// lists them in CPM_TERMS, e.g.
+//     #define CPM_TERMS Elongation, ContactInhibition
+#ifdef CPM_TERMS_HEADER
+#include CPM_TERMS_HEADER
+#endif
+#ifndef CPM_TERMS
+#define CPM_TERMS
+#endif
+
+typedef TermList<CPM_TERMS> RegisteredTerms;
+
+#endif // HAMILTONIAN_TERM_H_
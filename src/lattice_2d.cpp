@@ -2,114 +2,293 @@
 #include "ranxoshi256.h"
 #include "lattice_2d.h"
 #include "linalg.h"
-//#include <immintrin.h>
 #include <vector>
 #include <iostream>
-
-//#define ZORDERINDEXING
+#include <algorithm>
 
 using namespace std;
 
 typedef Lattice2d::LatticePoint LatticePoint;
 typedef Lattice2d::Point Point;
 
-Lattice2d::Lattice2d(int dimension): _dimension(dimension) {
-    _actValues = new int[dimension * dimension]();
-    _cellIds = new unsigned int[dimension * dimension]();
-    _field = new double[2*dimension * dimension]();
-#ifdef ZORDERINDEXING
-    _cellIdsReshaped = new unsigned int[dimension * dimension]();
-#endif
+static const int directions[8][2] = {{-1,1}, {0,1}, {1,1}, {1,0}, {1,-1},
+    {0,-1}, {-1,-1}, {-1,0}};
+
+// Voxels are stored with a one voxel halo around the lattice, so the
+// neighbours of any voxel are at fixed offsets from it and no coordinate
+// needs wrapping to read them. Along a periodic axis the halo mirrors the
+// opposite edge; along a wall it is medium and is never written.
+Lattice2d::Lattice2d(IntPoint dimensions, const vector<Boundary>& boundaries): 
+    _borderIndices((dimensions.x + 2) * (dimensions.y + 2)), 
+    _dimensions(dimensions), _rowStride(dimensions.x + 2) {
+    for (int axis = 0; axis < 2; axis++)
+        _boundaries[axis] = boundaries[axis];
+    _actValues = nullptr;
+    _typeCounts = nullptr;
+    _countedTypes = 0;
+    _voxelSlots = nullptr;
+    _cellTypes.assign(1, 0);
+    _cellIds = new unsigned int[indexCount()]();
+    _foreignCounts = new unsigned char[indexCount()]();
+    for (int i = 0; i < 8; i++)
+        _offsets[i] = directions[i][1] * _rowStride + directions[i][0];
+    int extent[3] = {_dimensions.x, _dimensions.y, 1};
+    int periods[3] = {period().x, period().y, 0};
+    _field = new GradientField(2, extent, periods);
 }
 
 Lattice2d::~Lattice2d() {
     delete[] _actValues;
     delete[] _cellIds;
-    delete[] _field;
+    delete[] _foreignCounts;
+    delete[] _typeCounts;
+    delete[] _voxelSlots;
+    delete _field;
 }
+
+// The ids of voxel (0, 0) onwards, with rows stride(1) apart.
 unsigned int* Lattice2d::getCellIds() {
-#ifdef ZORDERINDEXING
-    for (int x = 0; x < _dimension; x++) {
-        for (int y = 0; y < _dimension; y++) {
-            _cellIdsReshaped[y*_dimension+x] = _cellIds[index(x,y)];
+    return _cellIds + index(0, 0);
+}
+
+int* Lattice2d::getActValues() {
+    allocateActValues();
+    return _actValues + index(0, 0);
+}
+
+// Copies made before act values are allocated leave no trace, so cells
+// start out inactive when act is switched on later.
+void Lattice2d::allocateActValues() {
+    if (!_actValues)
+        _actValues = new int[indexCount()]();
+}
+
+// The x and y components of the chemotaxis field.
+GradientField& Lattice2d::getField() {
+    return *_field;
+}
+
+int Lattice2d::getAct(LatticePoint& point) {
+    return _actValues ? _actValues[index(point)] : 0;
+}
+
+// Counts the neighbour types of every voxel from now on, for numberOfTypes
+// types including medium, starting from the voxels as they are. Fewer than
+// two types drops the counts.
+void Lattice2d::keepTypeCounts(int numberOfTypes) {
+    int countedTypes = max(numberOfTypes - 1, 0);
+    if (countedTypes == _countedTypes)
+        return;
+    delete[] _typeCounts;
+    _typeCounts = nullptr;
+    _countedTypes = countedTypes;
+    if (countedTypes == 0)
+        return;
+    _typeCounts = new unsigned char[(size_t)indexCount() * countedTypes]();
+    for (int x = 0; x < _dimensions.x; x++) {
+        for (int y = 0; y < _dimensions.y; y++) {
+            auto point = getPoint(x, y);
+            if (point.type != 0)
+                moveTypeCount(x, y, 0, point.type);
         }
     }
-    return _cellIdsReshaped;
-#else
-    return _cellIds;
-#endif
+}
+
+// The counts of the neighbours of the voxel at point, one per type after
+// medium, or null while they are not kept.
+const unsigned char* Lattice2d::getTypeCounts(LatticePoint& point) {
+    if (!_typeCounts)
+        return nullptr;
+    return _typeCounts + (size_t)index(point) * _countedTypes;
+}
+
+// Moves the neighbours of a voxel from one type's count to another's, with
+// medium counted by neither. Away from the edges the neighbours are at
+// fixed offsets.
+void Lattice2d::moveTypeCount(int x, int y, int oldType, int newType) {
+    bool inner = x > 0 && x < _dimensions.x - 1 && y > 0 && 
+        y < _dimensions.y - 1;
+    int i = index(x, y);
+    for (int n = 0; n < 8; n++) {
+        int j = inner ? i + _offsets[n] : neighborIndex(x, y, n);
+        if (j < 0)
+            continue;
+        unsigned char* counts = _typeCounts + (size_t)j * _countedTypes;
+        if (oldType != 0)
+            counts[oldType - 1]--;
+        if (newType != 0)
+            counts[newType - 1]++;
+    }
+}
+
+// Distance between neighbouring voxels along an axis, in elements.
+int Lattice2d::stride(int axis) {
+    return axis == 0 ? 1 : _rowStride;
 }
 
 void Lattice2d::setPoint(int cellId, int x, int y, int time, int type) {
-    unsigned int id = cellId + (type << 24);
-    _cellIds[index(x,y)] = id;
-    _actValues[index(x,y)] = time;
+    setCellType(cellId, type);
+    int i = index(x, y);
+    unsigned int oldId = _cellIds[i];
+    writeVoxel(x, y, cellId, time);
+    moveCellVoxel(i, oldId, cellId);
     updateBorderTrackingAround(x, y);
 }
 
 void Lattice2d::updateBorderTrackingAround(int x, int y) {
-    if (isPartOfBorder(x,y)) {
-        _borderIndices.add(index(x,y));
+    updateBorderTracking(index(x, y));
+    for (int i = 0; i < 8; i++) {
+        int j = neighborIndex(x, y, i);
+        if (j >= 0)
+            updateBorderTracking(j);
+    }
+}
+
+void Lattice2d::updateBorderTracking(int i) {
+    if (_foreignCounts[i] > 0) {
+        _borderIndices.add(i);
     } else {
-        _borderIndices.remove(index(x,y));
+        _borderIndices.remove(i);
     }
-    for (int i = 0; i < 8; i++) {
-        LatticePoint neighbor = getNeighbor(x,y, i);
-        int nX = neighbor.x;
-        int nY = neighbor.y;
-        if (isPartOfBorder(nX,nY)) {
-            _borderIndices.add(index(nX,nY));
-        } else {
-            _borderIndices.remove(index(nX,nY));
+}
+
+bool Lattice2d::isPartOfBorder(int x, int y) {
+    return _foreignCounts[index(x, y)] > 0;
+}
+
+// Stores a voxel, including its copies in the halo, and moves the foreign
+// counts of the voxel and its neighbours, and their type counts if kept,
+// along with it. Only the cell part of the id counts for the foreign
+// counts, a type change alone does not make a border. A wall counts as
+// medium but keeps no count of its own.
+void Lattice2d::writeVoxel(int x, int y, unsigned int id, int act) {
+    int i = index(x, y);
+    unsigned int oldId = _cellIds[i];
+    unsigned int newId = id;
+    int oldType = _cellTypes[oldId];
+    int newType = _cellTypes[newId];
+
+    int xs[3] = {x};
+    int ys[3] = {y};
+    int xCount = 1;
+    int yCount = 1;
+    if (_boundaries[0] == Boundary::periodic) {
+        if (x == 0) xs[xCount++] = _dimensions.x;
+        if (x == _dimensions.x - 1) xs[xCount++] = -1;
+    }
+    if (_boundaries[1] == Boundary::periodic) {
+        if (y == 0) ys[yCount++] = _dimensions.y;
+        if (y == _dimensions.y - 1) ys[yCount++] = -1;
+    }
+    for (int b = 0; b < yCount; b++) {
+        for (int a = 0; a < xCount; a++) {
+            int j = index(xs[a], ys[b]);
+            _cellIds[j] = id;
+            if (_actValues)
+                _actValues[j] = act;
         }
     }
+
+    if (_typeCounts && oldType != newType)
+        moveTypeCount(x, y, oldType, newType);
+
+    if (oldId == newId)
+        return;
+    for (int n = 0; n < 8; n++) {
+        int j = neighborIndex(x, y, n);
+        unsigned int neighborId = j < 0 ? 0 : _cellIds[j];
+        int delta = (neighborId != newId) - (neighborId != oldId);
+        if (j >= 0)
+            _foreignCounts[j] += delta;
+        _foreignCounts[i] += delta;
+    }
 }
 
-bool Lattice2d::isPartOfBorder(int x, int y) {
-    int cellId = _cellIds[index(x,y)];
-    for (int i = 0; i < 8; i++) {
-        auto neighbor = getNeighbor(x, y, i);
-        if (neighbor.cellId != cellId)
-            return true;
+// Index of a neighbour inside the lattice, never one of the halo copies,
+// or -1 for a neighbour behind a wall.
+int Lattice2d::neighborIndex(int x, int y, int i) {
+    auto offset = directions[i];
+    int nX = wrap(x + offset[0], 0);
+    int nY = wrap(y + offset[1], 1);
+    if (!contains(nX, nY))
+        return -1;
+    return index(nX, nY);
+}
+
+// Coordinates past a wall are kept, and so land in the halo.
+int Lattice2d::wrap(int coordinate, int axis) {
+    if (_boundaries[axis] == Boundary::wall)
+        return coordinate;
+    int dimension = axis == 0 ? _dimensions.x : _dimensions.y;
+    if (coordinate < 0)
+        return coordinate + dimension;
+    if (coordinate >= dimension)
+        return coordinate - dimension;
+    return coordinate;
+}
+
+bool Lattice2d::contains(int x, int y) {
+    return x >= 0 && x < _dimensions.x && y >= 0 && y < _dimensions.y;
+}
+
+// False for the points behind a wall that getNeighbor returns.
+bool Lattice2d::contains(LatticePoint& point) {
+    return contains(point.x, point.y);
+}
+
+// Period of each axis, zero along walls.
+Lattice2d::IntPoint Lattice2d::period() {
+    return {_boundaries[0] == Boundary::periodic ? _dimensions.x : 0,
+        _boundaries[1] == Boundary::periodic ? _dimensions.y : 0};
+}
+
+// Whether the lattice splits into whole blocks that can be coloured like a
+// checkerboard, which needs an even number of blocks along periodic axes.
+bool Lattice2d::fitsBlocks(int blockSize) {
+    int dimensions[2] = {_dimensions.x, _dimensions.y};
+    for (int axis = 0; axis < 2; axis++) {
+        if (dimensions[axis] % blockSize != 0)
+            return false;
+        if (_boundaries[axis] == Boundary::periodic && 
+                (dimensions[axis] / blockSize) % 2 != 0)
+            return false;
     }
-    return false;
+    return true;
 }
 
 LatticePoint Lattice2d::getPoint(int i) {
-    auto id = _cellIds[i] & 16777215U;
-    auto act = 0;
-    if (_actToggle)
-        act = _actValues[i];
-    char type = _cellIds[i] >> 24;
-#ifdef ZORDERINDEXING
-    int x = _pext_u64(i, 0x5555555555555555);
-    int y = _pext_u64(i, 0xaaaaaaaaaaaaaaaa);
-#else
-    int x = i % _dimension;
-    int y = i / _dimension;
-#endif
-    return {id, type, x, y, act};
+    auto id = _cellIds[i];
+    char type = _cellTypes[id];
+    int x = i % _rowStride - 1;
+    int y = i / _rowStride - 1;
+    return {id, type, x, y};
 }
 
 
 Point Lattice2d::getFieldPoint(LatticePoint& point) {
-    auto i = index(point.x, point.y);
-    double x = _field[i];
-    double y = _field[i + 1 * size()];
-    return {x, y};
+    double vector[2];
+    _field->at(point.x, point.y, 0, vector);
+    return {vector[0], vector[1]};
 }
 
 LatticePoint Lattice2d::getPoint(int x, int y) {
-    auto id = _cellIds[index(x,y)] & 16777215U;
-    auto act = 0;
-    if (_actToggle)
-        act = _actValues[index(x,y)];
-    char type = _cellIds[index(x,y)] >> 24;
-    return {id, type, x, y, act};
+    auto id = _cellIds[index(x,y)];
+    char type = _cellTypes[id];
+    return {id, type, x, y};
 }
 
 int Lattice2d::size() {
-    return _dimension * _dimension;
+    return _dimensions.x * _dimensions.y;
+}
+
+// Indices run from 0 to indexCount(), halo included.
+int Lattice2d::indexCount() {
+    return _rowStride * (_dimensions.y + 2);
+}
+
+// Index of the voxel with the given number in row-major order.
+int Lattice2d::voxelIndex(int voxel) {
+    return index(voxel % _dimensions.x, voxel / _dimensions.x);
 }
 
 
@@ -117,17 +296,7 @@ int Lattice2d::size() {
 LatticePoint Lattice2d::getRandomBorderLocation(ranxoshi256& xoshi) {
     int r = ranxoshi256Next(&xoshi) % _borderIndices.size();
     int borderIndex = _borderIndices.get(r);
-
-#ifdef ZORDERINDEXING
-    int x = _pext_u64(borderIndex, 0x5555555555555555);
-    int y = _pext_u64(borderIndex, 0xaaaaaaaaaaaaaaaa);
-#else
-    int x = borderIndex % _dimension;
-    int y = borderIndex / _dimension;
-#endif
-    
-
-    return getPoint(x,y);
+    return getPoint(borderIndex);
 }
 
 LatticePoint Lattice2d::getRandomNeighbor(LatticePoint& point, 
@@ -141,55 +310,205 @@ LatticePoint Lattice2d::getNeighbor(LatticePoint& point, int i) {
 }
 
 LatticePoint Lattice2d::getNeighbor(int x, int y, int i) {
-    const int directions[8][2] = {{-1,1}, {0,1}, {1,1}, {1,0}, {1,-1},
-        {0,-1}, {-1,-1}, {-1,0}};
     auto offset = directions[i];
-    int nX = (x + offset[0] ) & (_dimension-1);
-    int nY = (y + offset[1] ) & (_dimension-1);
-    return getPoint(nX,nY);
+    return getPoint(wrap(x + offset[0], 0), wrap(y + offset[1], 1));
 }
 
 
+void Lattice2d::getNeighborhood(LatticePoint& point, 
+        Neighborhood& neighborhood) {
+    const int base = index(point.x, point.y);
+    const char* cellTypes = _cellTypes.data();
+    for (int i = 0; i < neighborCount; i++) {
+        int j = base + _offsets[i];
+        unsigned int id = _cellIds[j];
+        neighborhood.cellIds[i] = id;
+        neighborhood.types[i] = cellTypes[id];
+    }
+    if (_actValues) {
+        for (int i = 0; i < neighborCount; i++)
+            neighborhood.acts[i] = _actValues[base + _offsets[i]];
+    }
+}
+
 void Lattice2d::copy(LatticePoint& source, LatticePoint& target, int time) {
-    setPoint(source.cellId, target.x, target.y, time, source.type);
+    copyValues(source, target, time);
+    finishCopy(source, target);
+}
+
+// Writes the copied voxel and the foreign counts around it without touching
+// the border set, so that blocks of a parallel sweep can copy concurrently
+// and fix up the border set afterwards.
+void Lattice2d::copyValues(LatticePoint& source, LatticePoint& target, 
+        int time) {
+    writeVoxel(target.x, target.y, source.cellId, time);
+}
+
+// Brings the border set and the cell voxel lists up to date with a copy
+// written by copyValues. Copies have to be finished in the order they were
+// made, as target holds the cell the voxel was taken from.
+void Lattice2d::finishCopy(LatticePoint& source, LatticePoint& target) {
+    updateBorderTrackingAround(target.x, target.y);
+    moveCellVoxel(index(target), target.cellId, source.cellId);
+}
+
+void Lattice2d::updateBorderTrackingAround(LatticePoint& point) {
+    updateBorderTrackingAround(point.x, point.y);
+}
+
+int Lattice2d::blockCount(int blockSize) {
+    return (_dimensions.x / blockSize) * (_dimensions.y / blockSize);
+}
+
+int Lattice2d::blockOf(int i, int blockSize) {
+    auto p = getPoint(i);
+    return (p.y / blockSize) * (_dimensions.x / blockSize) + p.x / blockSize;
+}
+
+// Blocks are coloured like a checkerboard along each axis, so two blocks of
+// the same colour are always at least one block apart.
+int Lattice2d::blockColor(int block, int blockSize) {
+    int blocksX = _dimensions.x / blockSize;
+    int bX = block % blocksX;
+    int bY = block / blocksX;
+    return (bX % 2) + 2 * (bY % 2);
+}
+
+int Lattice2d::blockColorCount() {
+    return 4;
+}
+
+// Collects the blocks overlapping the square of the given radius around a
+// point by looking at its corners, which finds all of them as long as
+// blocks are at least 2 * radius wide. Blocks can be listed more than once.
+// Corners behind a wall are moved back onto the lattice.
+int Lattice2d::blocksAround(LatticePoint& point, int radius, int blockSize,
+        int* blocks) {
+    int count = 0;
+    int blocksX = _dimensions.x / blockSize;
+    int step = max(2 * radius, 1);
+    for (int dY = -radius; dY <= radius; dY += step) {
+        for (int dX = -radius; dX <= radius; dX += step) {
+            int x = min(max(wrap(point.x + dX, 0), 0), _dimensions.x - 1);
+            int y = min(max(wrap(point.y + dY, 1), 0), _dimensions.y - 1);
+            blocks[count++] = (y / blockSize) * blocksX + x / blockSize;
+        }
+    }
+    return count;
+}
+
+int Lattice2d::index(int x, int y) {
+    return (y + 1) * _rowStride + x + 1;
+}
+
+void Lattice2d::sitesAround(LatticePoint& point, int radius, 
+        vector<int>& sites) {
+    sites.clear();
+    for (int dY = -radius; dY <= radius; dY++) {
+        for (int dX = -radius; dX <= radius; dX++) {
+            int x = wrap(point.x + dX, 0);
+            int y = wrap(point.y + dY, 1);
+            if (contains(x, y))
+                sites.push_back(index(x, y));
+        }
+    }
 }
 
-int Lattice2d::index(unsigned int x, unsigned int y) {
-#ifdef ZORDERINDEXING
-    return _pdep_u64(x, 0x5555555555555555) | _pdep_u64(y,0xaaaaaaaaaaaaaaaa);
-#else
-    return y * _dimension + x;
-#endif
+int Lattice2d::index(LatticePoint& point) {
+    return index(point.x, point.y);
 }
 
+// The voxels of the cell in index order.
 vector<vec2> Lattice2d::getPoints(int cellId) {
+    auto voxels = getCellVoxels(cellId);
+    sort(voxels.begin(), voxels.end());
     vector<vec2> points;
-    for (int x = 0; x < _dimension; x++) {
-        for (int y = 0; y < _dimension; y++) {
-            auto p = getPoint(x, y);
-            if (p.cellId == cellId) {
-                points.push_back({float(x), float(y)});
-            }
-        }
+    for (int i: voxels) {
+        auto p = getPoint(i);
+        points.push_back({float(p.x), float(p.y)});
     }
     return points;
 }
 
+// Indices of the voxels of a cell, in no particular order. The first call
+// scans the lattice to build the lists of all cells, which are kept up to
+// date from then on, so later calls take time in proportion to the size of
+// the cell.
+const vector<int>& Lattice2d::getCellVoxels(int cellId) {
+    static const vector<int> none;
+    if (!_voxelSlots)
+        indexCellVoxels();
+    return cellId < (int)_cellVoxels.size() ? _cellVoxels[cellId] : none;
+}
+
+void Lattice2d::indexCellVoxels() {
+    _voxelSlots = new int[indexCount()]();
+    for (int v = 0; v < size(); v++) {
+        int i = voxelIndex(v);
+        moveCellVoxel(i, 0, _cellIds[i]);
+    }
+}
+
+// Moves voxel i from the list of one cell to that of another, where
+// medium has no list. Does nothing until the lists are built.
+void Lattice2d::moveCellVoxel(int i, unsigned int oldId, unsigned int newId) {
+    if (!_voxelSlots || oldId == newId)
+        return;
+    if (oldId != 0) {
+        auto& voxels = _cellVoxels[oldId];
+        int slot = _voxelSlots[i];
+        voxels[slot] = voxels.back();
+        _voxelSlots[voxels[slot]] = slot;
+        voxels.pop_back();
+    }
+    if (newId != 0) {
+        if (newId >= _cellVoxels.size())
+            _cellVoxels.resize(newId + 1);
+        _voxelSlots[i] = _cellVoxels[newId].size();
+        _cellVoxels[newId].push_back(i);
+    }
+}
 
 void Lattice2d::resetType(int cellId, int type) {
-    for (int x = 0; x < _dimension; x++) {
-        for (int y = 0; y < _dimension; y++) {
-            auto p = getPoint(x, y);
-            if (p.cellId == cellId) {
-                setPoint(cellId, x, y, p.act, type);
-            }
+    setCellType(cellId, type);
+}
+
+// Gives a cell its type, which all of its voxels take on at once, as
+// voxels only hold the cell id. Kept neighbour type counts are moved over
+// the voxels of the cell. Medium is always of type 0.
+void Lattice2d::setCellType(int cellId, int type) {
+    if (cellId == 0)
+        return;
+    if (cellId >= (int)_cellTypes.size()) {
+        _cellTypes.resize(cellId + 1, 0);
+        _cellTypes[cellId] = type;
+        return;
+    }
+    int oldType = _cellTypes[cellId];
+    if (oldType == type)
+        return;
+    _cellTypes[cellId] = type;
+    if (_typeCounts) {
+        for (int i: getCellVoxels(cellId)) {
+            auto p = getPoint(i);
+            moveTypeCount(p.x, p.y, oldType, type);
         }
     }
 }
 
+int Lattice2d::getCellType(int cellId) {
+    return cellId < (int)_cellTypes.size() ? _cellTypes[cellId] : 0;
+}
+
+// Types by cell id, starting with medium.
+const vector<char>& Lattice2d::getCellTypes() {
+    return _cellTypes;
+}
+
 void Lattice2d::setPoints(int id, const vector<vec2>& points, int type) {
     for (auto point: points) {
-        auto act = _actValues[index(point.x, point.y)];
+        auto act = _actValues ? 
+            _actValues[index(point.x, point.y)] : 0;
         setPoint(id, point.x, point.y, act, type);
     }
     for (auto point: points) {
@@ -197,32 +516,29 @@ void Lattice2d::setPoints(int id, const vector<vec2>& points, int type) {
     }
 }
 
+// Turns the voxels of a cell into medium. Its cell state is left to the
+// caller, see Cpm::killCell.
 void Lattice2d::remove(int id) {
-    //FIX: border tracking
-    for (int i = 0; i < _dimension * _dimension; i++) {
-        auto currentId = _cellIds[i] % (1<<24);
-        if (currentId == id) {
-            _cellIds[i] = 0;
-        }
+    auto voxels = getCellVoxels(id);
+    for (int i: voxels) {
+        auto p = getPoint(i);
+        writeVoxel(p.x, p.y, 0, getAct(p));
+        updateBorderTrackingAround(p.x, p.y);
+        moveCellVoxel(i, id, 0);
     }
 }
 
-
 Point Lattice2d::getCenterOfMass(int id) {
     double comX = 0;
     double comY = 0;
-    int count = 0;
-    for (int x = 0; x < _dimension; x++) {
-        for (int y = 0; y < _dimension; y++) {
-            auto p = getPoint(x, y);
-            if (p.cellId == id) {
-                comX += x;
-                comY += y;
-                count++;
-            }
-        }
+    auto& voxels = getCellVoxels(id);
+    for (int i: voxels) {
+        auto p = getPoint(i);
+        comX += p.x;
+        comY += p.y;
     }
 
+    int count = voxels.size();
     if (count > 0) {
         comX /= count;
         comY /= count;
@@ -233,10 +549,15 @@ Point Lattice2d::getCenterOfMass(int id) {
 
 
 
+const int* Lattice2d::getDirection(int i) {
+    return directions[i];
+}
+
 int Lattice2d::getNeighborCount() {
     return 8;
 }
 
-void Lattice2d::setAct(bool actToggle) {
-    _actToggle = actToggle;
+
+// 2D lattices are small enough to be stored densely, see Lattice3d.
+void Lattice2d::releaseEmptyBricks() {
 }
@@ -5,8 +5,10 @@
 #include <iostream>
 #include <random>
 #include <string>
-#include "dice_set.h"
+#include "paged_dice_set.h"
 #include "linalg.h"
+#include "boundary.h"
+#include "gradient_field.h"
 
 using namespace std;
 
@@ -21,7 +23,6 @@ class Lattice2d {
             char type;
             int x;
             int y;
-            int act;
 
             IntPoint times(int r) {
                 IntPoint a;
@@ -77,16 +78,18 @@ class Lattice2d {
             }
 
 
-            Point wrap(int dimension) {
+            // Nearest periodic image; a period of zero leaves that axis
+            // as it is.
+            Point wrap(const IntPoint& period) {
                 Point p = *this;
-                if (p.x > dimension/2)
-                    p.x -= dimension;
-                if (p.x < -dimension/2)
-                    p.x += dimension;
-                if (p.y > dimension/2)
-                    p.y -= dimension;
-                if (p.y < -dimension/2)
-                    p.y += dimension;
+                if (p.x > period.x/2)
+                    p.x -= period.x;
+                if (p.x < -period.x/2)
+                    p.x += period.x;
+                if (p.y > period.y/2)
+                    p.y -= period.y;
+                if (p.y < -period.y/2)
+                    p.y += period.y;
                 return p;
             }
 
@@ -98,9 +101,7 @@ class Lattice2d {
                 return p;
             }
 
-            void unitRandomize() {
-                random_device rng;
-                mt19937 urng(rng());
+            void unitRandomize(mt19937& urng) {
                 normal_distribution<double> distribution(0.0,1.0);
                 x = distribution(urng);
                 y = distribution(urng);
@@ -173,6 +174,28 @@ class Lattice2d {
                 return r;
             }
 
+            // The per-axis versions leave axes with a zero period alone.
+            IntPoint modulo(const IntPoint& m) {
+                IntPoint r;
+                r.x = m.x ? (x+m.x)%m.x : x;
+                r.y = m.y ? (y+m.y)%m.y : y;
+                return r;
+            }
+
+            IntPoint mul(const IntPoint& r) {
+                IntPoint p;
+                p.x = x * r.x;
+                p.y = y * r.y;
+                return p;
+            }
+
+            IntPoint intDiv(const IntPoint& r) {
+                IntPoint p;
+                p.x = r.x ? x/r.x : 0;
+                p.y = r.y ? y/r.y : 0;
+                return p;
+            }
+
             IntPoint mul(int r) {
                 IntPoint p;
                 p.x = x * r;
@@ -196,38 +219,107 @@ class Lattice2d {
                 
         };
 
-        Lattice2d(int dimension);
+        static const int neighborCount = 8;
+
+        // Ids, types and act values of the neighbours of one voxel, in
+        // getNeighbor order, read in a single pass. Act values are only
+        // filled in once the lattice keeps them.
+        struct Neighborhood {
+            unsigned int cellIds[neighborCount];
+            char types[neighborCount];
+            int acts[neighborCount];
+        };
+
+        Lattice2d(IntPoint dimensions, 
+                const std::vector<Boundary>& boundaries);
         int getNeighborCount();
+        // Offset of the i-th neighbour, in getNeighbor order.
+        static const int* getDirection(int i);
         void setPoint(int cellId, int x, int y, int time, int type);
         LatticePoint getPoint(int i);
         LatticePoint getPoint(int x, int y);
         int size();
+        int indexCount();
+        int voxelIndex(int voxel);
+        bool contains(LatticePoint& point);
+        IntPoint period();
+        bool fitsBlocks(int blockSize);
         LatticePoint getRandomBorderLocation(ranxoshi256& xoshi);
         LatticePoint getRandomNeighbor(LatticePoint& point, ranxoshi256& xoshi);
         LatticePoint getNeighbor(LatticePoint& point, int i);
+        void getNeighborhood(LatticePoint& point, Neighborhood& neighborhood);
         LatticePoint getNeighbor(int x, int y, int i);
         Point getCenterOfMass(int id);
         bool isPartOfBorder(int x, int y);
         void copy(LatticePoint& source, LatticePoint& target, int time);
+        void copyValues(LatticePoint& source, LatticePoint& target, int time);
+        void finishCopy(LatticePoint& source, LatticePoint& target);
         void updateBorderTrackingAround(int x, int y);
-        int index(unsigned int x, unsigned int y);
+        void updateBorderTrackingAround(LatticePoint& point);
+        int blockCount(int blockSize);
+        int blockOf(int i, int blockSize);
+        int blockColor(int block, int blockSize);
+        int blockColorCount();
+        int blocksAround(LatticePoint& point, int radius, int blockSize, 
+                int* blocks);
+        void sitesAround(LatticePoint& point, int radius, 
+                std::vector<int>& sites);
+        int index(int x, int y);
+        int index(LatticePoint& point);
         std::vector<vec2> getPoints(int cellId);
+        const std::vector<int>& getCellVoxels(int cellId);
         void setPoints(int id, const std::vector<vec2>& points, int type);
         void resetType(int cellId, int type);
+        void setCellType(int cellId, int type);
+        int getCellType(int cellId);
+        const std::vector<char>& getCellTypes();
         void remove(int id);
         Point getFieldPoint(LatticePoint& point);
         unsigned int* getCellIds();
-        void setAct(bool actToggle);
+        int* getActValues();
+        int stride(int axis);
+        void allocateActValues();
+        GradientField& getField();
+        int getAct(LatticePoint& point);
+        void keepTypeCounts(int numberOfTypes);
+        const unsigned char* getTypeCounts(LatticePoint& point);
+        void releaseEmptyBricks();
         ~Lattice2d();
 
-        DiceSet _borderIndices;
+        PagedDiceSet _borderIndices;
+        // Cell id of every voxel, 0 for medium. Types are kept per cell.
         unsigned int* _cellIds;
-        unsigned int* _cellIdsReshaped;
-        double* _field;
+        std::vector<char> _cellTypes;
+        // Number of neighbours of each voxel belonging to another cell; a
+        // voxel is on the border exactly when its count is nonzero.
+        unsigned char* _foreignCounts;
+        // Number of neighbours of each voxel of every type but medium, with
+        // _countedTypes entries per voxel, or null while not kept.
+        unsigned char* _typeCounts;
+        int _countedTypes;
+        // Indices of the voxels of each cell, by cell id, and the position
+        // of every cell voxel in its cell's list. Null and empty until the
+        // first per-cell query builds them.
+        std::vector<std::vector<int>> _cellVoxels;
+        int* _voxelSlots;
+        // Act values are only allocated once something uses them, and are
+        // null until then; the field allocates its own values lazily.
+        GradientField* _field;
         int* _actValues;
-        const int _dimension;
-        bool _actToggle;
+        // Extent along each axis, halo excluded.
+        IntPoint _dimensions;
+        Boundary _boundaries[2];
     private:
+        void writeVoxel(int x, int y, unsigned int id, int act);
+        int neighborIndex(int x, int y, int i);
+        int wrap(int coordinate, int axis);
+        bool contains(int x, int y);
+        void moveTypeCount(int x, int y, int oldType, int newType);
+        void indexCellVoxels();
+        void moveCellVoxel(int i, unsigned int oldId, unsigned int newId);
+        const int _rowStride;
+        int _offsets[8];
+        void updateBorderTracking(int i);
 }; 
 
 #endif // LATTICE_H_
@@ -2,110 +2,398 @@
 #include "ranxoshi256.h"
 #include "lattice_3d.h"
 #include "linalg.h"
-//#include <immintrin.h> 
+#include "sparse_memory.h"
 #include <vector>
 #include <iostream>
-
-//#define ZORDERINDEXING
+#include <algorithm>
 
 using namespace std;
 
 typedef Lattice3d::LatticePoint LatticePoint;
 typedef Lattice3d::Point Point;
 
-Lattice3d::Lattice3d(int dimension): _dimension(dimension) {
-    _actValues = new int[dimension * dimension * dimension]();
-    _cellIds = new unsigned int[dimension * dimension * dimension]();
-    _field = new double[3*dimension * dimension * dimension]();
+static const int directions[26][3] = {{-1,1,1}, {0,1,1}, {1,1,1}, {1,0,1}, 
+    {1,-1,1}, {0,-1,1}, {-1,-1,1}, {-1,0,1}, {0,0,1}, {-1,1,0}, {0,1,0}, 
+    {1,1,0}, {1,0,0}, {1,-1,0}, {0,-1,0}, {-1,-1,0}, {-1,0,0}, {-1,1,-1}, 
+    {0,1,-1}, {1,1,-1}, {1,0,-1}, {1,-1,-1}, {0,-1,-1}, {-1,-1,-1}, 
+    {-1,0,-1}, {0,0,-1}};
+
+// Voxels are stored with a one voxel halo around the lattice, so the
+// neighbours of any voxel are at fixed offsets from it and no coordinate
+// needs wrapping to read them. Along a periodic axis the halo mirrors the
+// opposite face; along a wall it is medium and is never written.
+Lattice3d::Lattice3d(IntPoint dimensions, const vector<Boundary>& boundaries): 
+    _borderIndices((dimensions.x + 2) * (dimensions.y + 2) * 
+            (dimensions.z + 2)), 
+    _dimensions(dimensions), _rowStride(dimensions.x + 2), 
+    _planeStride((dimensions.x + 2) * (dimensions.y + 2)) {
+    for (int axis = 0; axis < 3; axis++)
+        _boundaries[axis] = boundaries[axis];
+    _actValues = nullptr;
+    _typeCounts = nullptr;
+    _countedTypes = 0;
+    _voxelSlots = nullptr;
+    _cellTypes.assign(1, 0);
+    _cellIds = (unsigned int*)allocateSparse(
+            indexCount() * sizeof(unsigned int));
+    _foreignCounts = (unsigned char*)allocateSparse(indexCount());
+    _brickUse = new atomic<int>[brickCount()]();
+    _brickWritten = new atomic<bool>[brickCount()]();
+    for (int i = 0; i < 26; i++)
+        _offsets[i] = directions[i][2] * _planeStride + 
+            directions[i][1] * _rowStride + directions[i][0];
+    int extent[3] = {_dimensions.x, _dimensions.y, _dimensions.z};
+    int periods[3] = {period().x, period().y, period().z};
+    _field = new GradientField(3, extent, periods);
 }
 
 Lattice3d::~Lattice3d() {
-    delete[] _actValues;
-    delete[] _cellIds;
-    delete[] _field;
+    if (_actValues)
+        freeSparse(_actValues, indexCount() * sizeof(int));
+    freeSparse(_cellIds, indexCount() * sizeof(unsigned int));
+    freeSparse(_foreignCounts, indexCount());
+    if (_typeCounts)
+        freeSparse(_typeCounts, (size_t)indexCount() * _countedTypes);
+    if (_voxelSlots)
+        freeSparse(_voxelSlots, indexCount() * sizeof(int));
+    delete _field;
+    delete[] _brickUse;
+    delete[] _brickWritten;
 }
 
 void Lattice3d::setPoint(int cellId, int x, int y, int z, int time, int type) {
-    unsigned int id = cellId + (type << 24);
-    _cellIds[index(x,y,z)] = id;
-    _actValues[index(x,y,z)] = time;
-
-
+    setCellType(cellId, type);
+    int i = index(x, y, z);
+    unsigned int oldId = _cellIds[i];
+    writeVoxel(x, y, z, cellId, time);
+    moveCellVoxel(i, oldId, cellId);
     updateBorderTrackingAround(x, y, z);
 }
 
+// The ids of voxel (0, 0, 0) onwards, with rows stride(1) and planes
+// stride(2) apart.
 unsigned int* Lattice3d::getCellIds() {
-    return _cellIds;
+    return _cellIds + index(0, 0, 0);
+}
+
+int* Lattice3d::getActValues() {
+    allocateActValues();
+    return _actValues + index(0, 0, 0);
+}
+
+// Copies made before act values are allocated leave no trace, so cells
+// start out inactive when act is switched on later.
+void Lattice3d::allocateActValues() {
+    if (!_actValues)
+        _actValues = (int*)allocateSparse(indexCount() * sizeof(int));
+}
+
+// The x, y and z components of the chemotaxis field.
+GradientField& Lattice3d::getField() {
+    return *_field;
+}
+
+int Lattice3d::getAct(LatticePoint& point) {
+    return _actValues ? _actValues[index(point)] : 0;
+}
+
+// Counts the neighbour types of every voxel from now on, for numberOfTypes
+// types including medium, starting from the voxels as they are. Fewer than
+// two types drops the counts. Only written bricks can hold cells, and only
+// bricks in use can hold nonzero counts, so the counts are as sparse as
+// the lattice.
+void Lattice3d::keepTypeCounts(int numberOfTypes) {
+    int countedTypes = max(numberOfTypes - 1, 0);
+    if (countedTypes == _countedTypes)
+        return;
+    if (_typeCounts)
+        freeSparse(_typeCounts, (size_t)indexCount() * _countedTypes);
+    _typeCounts = nullptr;
+    _countedTypes = countedTypes;
+    if (countedTypes == 0)
+        return;
+    _typeCounts = (unsigned char*)allocateSparse(
+            (size_t)indexCount() * countedTypes);
+    for (int brick = 0; brick < brickCount(); brick++) {
+        if (!_brickWritten[brick])
+            continue;
+        int first = brick << brickBits;
+        int last = min(first + (1 << brickBits), indexCount());
+        for (int i = first; i < last; i++) {
+            auto point = getPoint(i);
+            if (point.type != 0 && contains(point.x, point.y, point.z))
+                moveTypeCount(point.x, point.y, point.z, 0, point.type);
+        }
+    }
+}
+
+// The counts of the neighbours of the voxel at point, one per type after
+// medium, or null while they are not kept.
+const unsigned char* Lattice3d::getTypeCounts(LatticePoint& point) {
+    if (!_typeCounts)
+        return nullptr;
+    return _typeCounts + (size_t)index(point) * _countedTypes;
+}
+
+// Moves the neighbours of a voxel from one type's count to another's, with
+// medium counted by neither. Away from the edges the neighbours are at
+// fixed offsets.
+void Lattice3d::moveTypeCount(int x, int y, int z, int oldType, 
+        int newType) {
+    bool inner = x > 0 && x < _dimensions.x - 1 && y > 0 && 
+        y < _dimensions.y - 1 && z > 0 && z < _dimensions.z - 1;
+    int i = index(x, y, z);
+    for (int n = 0; n < 26; n++) {
+        int j = inner ? i + _offsets[n] : neighborIndex(x, y, z, n);
+        if (j < 0)
+            continue;
+        unsigned char* counts = _typeCounts + (size_t)j * _countedTypes;
+        if (oldType != 0)
+            counts[oldType - 1]--;
+        if (newType != 0)
+            counts[newType - 1]++;
+    }
+}
+
+// Distance between neighbouring voxels along an axis, in elements.
+int Lattice3d::stride(int axis) {
+    if (axis == 0)
+        return 1;
+    return axis == 1 ? _rowStride : _planeStride;
 }
 
 void Lattice3d::updateBorderTrackingAround(int x, int y, int z) {
-    if (isPartOfBorder(x,y,z)) {
-        _borderIndices.add(index(x,y,z));
+    updateBorderTracking(index(x, y, z));
+    for (int i = 0; i < 26; i++) {
+        int j = neighborIndex(x, y, z, i);
+        if (j >= 0)
+            updateBorderTracking(j);
+    }
+}
+
+void Lattice3d::updateBorderTracking(int i) {
+    if (_foreignCounts[i] > 0) {
+        _borderIndices.add(i);
     } else {
-        _borderIndices.remove(index(x,y,z));
+        _borderIndices.remove(i);
+    }
+}
+
+bool Lattice3d::isPartOfBorder(int x, int y, int z) {
+    return _foreignCounts[index(x, y, z)] > 0;
+}
+
+// Stores a voxel, including its copies in the halo, and moves the foreign
+// counts of the voxel and its neighbours, and their type counts if kept,
+// along with it. Only the cell part of the id counts for the foreign
+// counts, a type change alone does not make a border. A wall counts as
+// medium but keeps no count of its own. Medium keeps no act value,
+// so that empty bricks hold nothing but zeros.
+void Lattice3d::writeVoxel(int x, int y, int z, unsigned int id, int act) {
+    int i = index(x, y, z);
+    unsigned int oldId = _cellIds[i];
+    unsigned int newId = id;
+    int oldType = _cellTypes[oldId];
+    int newType = _cellTypes[newId];
+    bool wasUsed = isUsed(i);
+
+    int xs[3] = {x};
+    int ys[3] = {y};
+    int zs[3] = {z};
+    int xCount = 1;
+    int yCount = 1;
+    int zCount = 1;
+    if (_boundaries[0] == Boundary::periodic) {
+        if (x == 0) xs[xCount++] = _dimensions.x;
+        if (x == _dimensions.x - 1) xs[xCount++] = -1;
+    }
+    if (_boundaries[1] == Boundary::periodic) {
+        if (y == 0) ys[yCount++] = _dimensions.y;
+        if (y == _dimensions.y - 1) ys[yCount++] = -1;
     }
-    for (int i = 0; i < getNeighborCount(); i++) {
-        LatticePoint neighbor = getNeighbor(x,y,z, i);
-        int nX = neighbor.x;
-        int nY = neighbor.y;
-        int nZ = neighbor.z;
-        if (isPartOfBorder(nX,nY,nZ)) {
-            _borderIndices.add(index(nX,nY,nZ));
-        } else {
-            _borderIndices.remove(index(nX,nY,nZ));
+    if (_boundaries[2] == Boundary::periodic) {
+        if (z == 0) zs[zCount++] = _dimensions.z;
+        if (z == _dimensions.z - 1) zs[zCount++] = -1;
+    }
+    for (int c = 0; c < zCount; c++) {
+        for (int b = 0; b < yCount; b++) {
+            for (int a = 0; a < xCount; a++) {
+                int j = index(xs[a], ys[b], zs[c]);
+                bool copyWasUsed = isUsed(j);
+                markWritten(j);
+                _cellIds[j] = id;
+                if (_actValues)
+                    _actValues[j] = newId ? act : 0;
+                if (j != i)
+                    trackUse(j, copyWasUsed);
+            }
+        }
+    }
+
+    if (_typeCounts && oldType != newType)
+        moveTypeCount(x, y, z, oldType, newType);
+
+    if (oldId == newId)
+        return;
+    for (int n = 0; n < 26; n++) {
+        int j = neighborIndex(x, y, z, n);
+        unsigned int neighborId = j < 0 ? 0 : _cellIds[j];
+        int delta = (neighborId != newId) - (neighborId != oldId);
+        if (delta == 0)
+            continue;
+        if (j >= 0 && j != i) {
+            bool neighborWasUsed = isUsed(j);
+            _foreignCounts[j] += delta;
+            trackUse(j, neighborWasUsed);
+        } else if (j == i) {
+            _foreignCounts[i] += delta;
         }
+        _foreignCounts[i] += delta;
     }
+    trackUse(i, wasUsed);
 }
 
-bool Lattice3d::isPartOfBorder(int x, int y, int z) {
-    int cellId = _cellIds[index(x,y,z)];
-    for (int i = 0; i < getNeighborCount(); i++) {
-        auto neighbor = getNeighbor(x, y, z, i);
-        if (neighbor.cellId != cellId)
-            return true;
+bool Lattice3d::isUsed(int i) {
+    return _cellIds[i] != 0 || _foreignCounts[i] != 0;
+}
+
+void Lattice3d::trackUse(int i, bool wasUsed) {
+    bool used = isUsed(i);
+    if (used == wasUsed)
+        return;
+    int brick = i >> brickBits;
+    if (used) {
+        _brickUse[brick]++;
+        markWritten(i);
+    } else {
+        _brickUse[brick]--;
     }
-    return false;
+}
+
+void Lattice3d::markWritten(int i) {
+    auto& written = _brickWritten[i >> brickBits];
+    if (!written)
+        written = true;
+}
+
+int Lattice3d::brickCount() {
+    return (indexCount() >> brickBits) + 1;
+}
+
+// Gives the memory of written bricks that no longer hold or border a cell
+// back to the system. Must not run while voxels are being written.
+void Lattice3d::releaseEmptyBricks() {
+    for (int brick = 0; brick < brickCount(); brick++) {
+        if (!_brickWritten[brick] || _brickUse[brick] > 0)
+            continue;
+        size_t first = (size_t)brick << brickBits;
+        size_t count = min((size_t)1 << brickBits, indexCount() - first);
+        releaseSparse(_cellIds + first, count * sizeof(unsigned int));
+        if (_actValues)
+            releaseSparse(_actValues + first, count * sizeof(int));
+        releaseSparse(_foreignCounts + first, count);
+        if (_typeCounts)
+            releaseSparse(_typeCounts + first * _countedTypes, 
+                    count * _countedTypes);
+        if (_voxelSlots)
+            releaseSparse(_voxelSlots + first, count * sizeof(int));
+        _brickWritten[brick] = false;
+    }
+}
+
+// Index of a neighbour inside the lattice, never one of the halo copies,
+// or -1 for a neighbour behind a wall.
+int Lattice3d::neighborIndex(int x, int y, int z, int i) {
+    auto offset = directions[i];
+    int nX = wrap(x + offset[0], 0);
+    int nY = wrap(y + offset[1], 1);
+    int nZ = wrap(z + offset[2], 2);
+    if (!contains(nX, nY, nZ))
+        return -1;
+    return index(nX, nY, nZ);
+}
+
+// Coordinates past a wall are kept, and so land in the halo.
+int Lattice3d::wrap(int coordinate, int axis) {
+    if (_boundaries[axis] == Boundary::wall)
+        return coordinate;
+    int dimension = axis == 0 ? _dimensions.x : 
+        (axis == 1 ? _dimensions.y : _dimensions.z);
+    if (coordinate < 0)
+        return coordinate + dimension;
+    if (coordinate >= dimension)
+        return coordinate - dimension;
+    return coordinate;
+}
+
+bool Lattice3d::contains(int x, int y, int z) {
+    return x >= 0 && x < _dimensions.x && y >= 0 && y < _dimensions.y &&
+        z >= 0 && z < _dimensions.z;
+}
+
+// False for the points behind a wall that getNeighbor returns.
+bool Lattice3d::contains(LatticePoint& point) {
+    return contains(point.x, point.y, point.z);
+}
+
+// Period of each axis, zero along walls.
+Lattice3d::IntPoint Lattice3d::period() {
+    return {_boundaries[0] == Boundary::periodic ? _dimensions.x : 0,
+        _boundaries[1] == Boundary::periodic ? _dimensions.y : 0,
+        _boundaries[2] == Boundary::periodic ? _dimensions.z : 0};
+}
+
+// Whether the lattice splits into whole blocks that can be coloured like a
+// checkerboard, which needs an even number of blocks along periodic axes.
+bool Lattice3d::fitsBlocks(int blockSize) {
+    int dimensions[3] = {_dimensions.x, _dimensions.y, _dimensions.z};
+    for (int axis = 0; axis < 3; axis++) {
+        if (dimensions[axis] % blockSize != 0)
+            return false;
+        if (_boundaries[axis] == Boundary::periodic && 
+                (dimensions[axis] / blockSize) % 2 != 0)
+            return false;
+    }
+    return true;
 }
 
 
 LatticePoint Lattice3d::getPoint(int x, int y, int z) {
-    auto id = _cellIds[index(x,y,z)] & 16777215U;
-    auto act = 0;
-    if (_actToggle)
-        act = _actValues[index(x,y,z)];
-    char type = _cellIds[index(x,y,z)] >> 24;
-    return {id, type, x, y, z, act};
+    auto id = _cellIds[index(x,y,z)];
+    char type = _cellTypes[id];
+    return {id, type, x, y, z};
 }
 
 
 Point Lattice3d::getFieldPoint(LatticePoint& point) {
-    auto i = index(point.x, point.y, point.z);
-    double x = _field[i];
-    double y = _field[i + 1 * size()];
-    double z = _field[i + 2 * size()];
-    return {x, y, z};
+    double vector[3];
+    _field->at(point.x, point.y, point.z, vector);
+    return {vector[0], vector[1], vector[2]};
 }
 
 LatticePoint Lattice3d::getPoint(int i) {
-    auto id = _cellIds[i] & 16777215U;
-    auto act = 0;
-    if (_actToggle)
-        act = _actValues[i];
-    char type = _cellIds[i] >> 24;
-#ifdef ZORDERINDEXING
-    int x = _pext_u64(i, 0x9249249249249249);
-    int y = _pext_u64(i, 0x2492492492492492);
-    int z = _pext_u64(i, 0x4924924924924924);
-#else
-    int x = i % _dimension;
-    int y = (i %(_dimension * _dimension)) / _dimension;
-    int z = i / (_dimension*_dimension);
-#endif
-    return {id, type, x, y, z, act};
+    auto id = _cellIds[i];
+    char type = _cellTypes[id];
+    int x = i % _rowStride - 1;
+    int y = (i / _rowStride) % (_dimensions.y + 2) - 1;
+    int z = i / _planeStride - 1;
+    return {id, type, x, y, z};
 }
 
 int Lattice3d::size() {
-    return _dimension * _dimension * _dimension;
+    return _dimensions.x * _dimensions.y * _dimensions.z;
+}
+
+// Indices run from 0 to indexCount(), halo included.
+int Lattice3d::indexCount() {
+    return _planeStride * (_dimensions.z + 2);
+}
+
+// Index of the voxel with the given number in row-major order.
+int Lattice3d::voxelIndex(int voxel) {
+    return index(voxel % _dimensions.x, 
+            (voxel / _dimensions.x) % _dimensions.y, 
+            voxel / (_dimensions.x * _dimensions.y));
 }
 
 
@@ -113,20 +401,7 @@ int Lattice3d::size() {
 LatticePoint Lattice3d::getRandomBorderLocation(ranxoshi256& xoshi) {
     int r = ranxoshi256Next(&xoshi) % _borderIndices.size();
     int borderIndex = _borderIndices.get(r);
-
-    
-#ifdef ZORDERINDEXING
-    int x = _pext_u64(borderIndex, 0x9249249249249249);
-    int y = _pext_u64(borderIndex, 0x2492492492492492);
-    int z = _pext_u64(borderIndex, 0x4924924924924924);
-#else
-    int x = borderIndex % _dimension;
-    int y = (borderIndex %(_dimension * _dimension)) / _dimension;
-    int z = borderIndex / (_dimension*_dimension);
-#endif
-    
-
-    return getPoint(x,y,z);
+    return getPoint(borderIndex);
 }
 
 LatticePoint Lattice3d::getRandomNeighbor(LatticePoint& point, 
@@ -140,65 +415,225 @@ LatticePoint Lattice3d::getNeighbor(LatticePoint& point, int i) {
 }
 
 LatticePoint Lattice3d::getNeighbor(int x, int y, int z, int i) {
-    const int directions[26][3] = {{-1,1,1}, {0,1,1}, {1,1,1}, {1,0,1}, 
-        {1,-1,1}, {0,-1,1}, {-1,-1,1}, {-1,0,1}, {0,0,1}, {-1,1,0}, {0,1,0}, 
-        {1,1,0}, {1,0,0}, {1,-1,0}, {0,-1,0}, {-1,-1,0}, {-1,0,0}, {-1,1,-1}, 
-        {0,1,-1}, {1,1,-1}, {1,0,-1}, {1,-1,-1}, {0,-1,-1}, {-1,-1,-1}, 
-        {-1,0,-1}, {0,0,-1}};
     auto offset = directions[i];
-    int nX = (x + offset[0] ) & (_dimension-1);
-    int nY = (y + offset[1] ) & (_dimension-1);
-    int nZ = (z + offset[2] ) & (_dimension-1);
-    return getPoint(nX,nY,nZ);
+    return getPoint(wrap(x + offset[0], 0), wrap(y + offset[1], 1), 
+            wrap(z + offset[2], 2));
 }
 
 
+void Lattice3d::getNeighborhood(LatticePoint& point, 
+        Neighborhood& neighborhood) {
+    const int base = index(point.x, point.y, point.z);
+    const char* cellTypes = _cellTypes.data();
+    for (int i = 0; i < neighborCount; i++) {
+        int j = base + _offsets[i];
+        unsigned int id = _cellIds[j];
+        neighborhood.cellIds[i] = id;
+        neighborhood.types[i] = cellTypes[id];
+    }
+    if (_actValues) {
+        for (int i = 0; i < neighborCount; i++)
+            neighborhood.acts[i] = _actValues[base + _offsets[i]];
+    }
+}
+
 void Lattice3d::copy(LatticePoint& source, LatticePoint& target, int time) {
-    setPoint(source.cellId, target.x, target.y, target.z, time, source.type);
+    copyValues(source, target, time);
+    finishCopy(source, target);
 }
 
-int Lattice3d::index(unsigned int x, unsigned int y, unsigned int z) {
-#ifdef ZORDERINDEXING
-    return _pdep_u64(x, 0x9249249249249249) | 
-        _pdep_u64(y, 0x2492492492492492) | 
-        _pdep_u64(z, 0x4924924924924924);
-#else
-    return z * _dimension * _dimension + y * _dimension + x;
-#endif
+// Writes the copied voxel and the foreign counts around it without touching
+// the border set, so that blocks of a parallel sweep can copy concurrently
+// and fix up the border set afterwards.
+void Lattice3d::copyValues(LatticePoint& source, LatticePoint& target, 
+        int time) {
+    writeVoxel(target.x, target.y, target.z, source.cellId, time);
 }
 
-vector<vec3> Lattice3d::getPoints(int cellId) {
-    vector<vec3> points;
-    for (int x = 0; x < _dimension; x++) {
-        for (int y = 0; y < _dimension; y++) {
-            for (int z = 0; z < _dimension; z++) {
-                auto p = getPoint(x, y, z);
-                if (p.cellId == cellId) {
-                    points.push_back({float(x), float(y), float(z)});
-                }
+// Brings the border set and the cell voxel lists up to date with a copy
+// written by copyValues. Copies have to be finished in the order they were
+// made, as target holds the cell the voxel was taken from.
+void Lattice3d::finishCopy(LatticePoint& source, LatticePoint& target) {
+    updateBorderTrackingAround(target.x, target.y, target.z);
+    moveCellVoxel(index(target), target.cellId, source.cellId);
+}
+
+void Lattice3d::updateBorderTrackingAround(LatticePoint& point) {
+    updateBorderTrackingAround(point.x, point.y, point.z);
+}
+
+int Lattice3d::blockCount(int blockSize) {
+    return (_dimensions.x / blockSize) * (_dimensions.y / blockSize) * 
+        (_dimensions.z / blockSize);
+}
+
+int Lattice3d::blockOf(int i, int blockSize) {
+    auto p = getPoint(i);
+    return ((p.z / blockSize) * (_dimensions.y / blockSize) + 
+            p.y / blockSize) * (_dimensions.x / blockSize) + p.x / blockSize;
+}
+
+// Blocks are coloured like a checkerboard along each axis, so two blocks of
+// the same colour are always at least one block apart.
+int Lattice3d::blockColor(int block, int blockSize) {
+    int blocksX = _dimensions.x / blockSize;
+    int blocksY = _dimensions.y / blockSize;
+    int bX = block % blocksX;
+    int bY = (block / blocksX) % blocksY;
+    int bZ = block / (blocksX * blocksY);
+    return (bX % 2) + 2 * (bY % 2) + 4 * (bZ % 2);
+}
+
+int Lattice3d::blockColorCount() {
+    return 8;
+}
+
+// Collects the blocks overlapping the cube of the given radius around a
+// point by looking at its corners, which finds all of them as long as
+// blocks are at least 2 * radius wide. Blocks can be listed more than once.
+// Corners behind a wall are moved back onto the lattice.
+int Lattice3d::blocksAround(LatticePoint& point, int radius, int blockSize,
+        int* blocks) {
+    int count = 0;
+    int blocksX = _dimensions.x / blockSize;
+    int blocksY = _dimensions.y / blockSize;
+    int step = max(2 * radius, 1);
+    for (int dZ = -radius; dZ <= radius; dZ += step) {
+        for (int dY = -radius; dY <= radius; dY += step) {
+            for (int dX = -radius; dX <= radius; dX += step) {
+                int x = min(max(wrap(point.x + dX, 0), 0), _dimensions.x - 1);
+                int y = min(max(wrap(point.y + dY, 1), 0), _dimensions.y - 1);
+                int z = min(max(wrap(point.z + dZ, 2), 0), _dimensions.z - 1);
+                blocks[count++] = ((z / blockSize) * blocksY + y / blockSize) *
+                    blocksX + x / blockSize;
             }
         }
     }
+    return count;
+}
+
+int Lattice3d::index(int x, int y, int z) {
+    return (z + 1) * _planeStride + (y + 1) * _rowStride + x + 1;
+}
+
+void Lattice3d::sitesAround(LatticePoint& point, int radius, 
+        vector<int>& sites) {
+    sites.clear();
+    for (int dZ = -radius; dZ <= radius; dZ++) {
+        for (int dY = -radius; dY <= radius; dY++) {
+            for (int dX = -radius; dX <= radius; dX++) {
+                int x = wrap(point.x + dX, 0);
+                int y = wrap(point.y + dY, 1);
+                int z = wrap(point.z + dZ, 2);
+                if (contains(x, y, z))
+                    sites.push_back(index(x, y, z));
+            }
+        }
+    }
+}
+
+int Lattice3d::index(LatticePoint& point) {
+    return index(point.x, point.y, point.z);
+}
+
+// The voxels of the cell in index order.
+vector<vec3> Lattice3d::getPoints(int cellId) {
+    auto voxels = getCellVoxels(cellId);
+    sort(voxels.begin(), voxels.end());
+    vector<vec3> points;
+    for (int i: voxels) {
+        auto p = getPoint(i);
+        points.push_back({float(p.x), float(p.y), float(p.z)});
+    }
     return points;
 }
 
+// Indices of the voxels of a cell, in no particular order. The first call
+// scans the written bricks to build the lists of all cells, which are kept
+// up to date from then on, so later calls take time in proportion to the
+// size of the cell.
+const vector<int>& Lattice3d::getCellVoxels(int cellId) {
+    static const vector<int> none;
+    if (!_voxelSlots)
+        indexCellVoxels();
+    return cellId < (int)_cellVoxels.size() ? _cellVoxels[cellId] : none;
+}
+
+void Lattice3d::indexCellVoxels() {
+    _voxelSlots = (int*)allocateSparse(indexCount() * sizeof(int));
+    for (int brick = 0; brick < brickCount(); brick++) {
+        if (!_brickWritten[brick])
+            continue;
+        int first = brick << brickBits;
+        int last = min(first + (1 << brickBits), indexCount());
+        for (int i = first; i < last; i++) {
+            auto point = getPoint(i);
+            if (contains(point.x, point.y, point.z))
+                moveCellVoxel(i, 0, point.cellId);
+        }
+    }
+}
+
+// Moves voxel i from the list of one cell to that of another, where
+// medium has no list. Does nothing until the lists are built.
+void Lattice3d::moveCellVoxel(int i, unsigned int oldId, unsigned int newId) {
+    if (!_voxelSlots || oldId == newId)
+        return;
+    if (oldId != 0) {
+        auto& voxels = _cellVoxels[oldId];
+        int slot = _voxelSlots[i];
+        voxels[slot] = voxels.back();
+        _voxelSlots[voxels[slot]] = slot;
+        voxels.pop_back();
+    }
+    if (newId != 0) {
+        if (newId >= _cellVoxels.size())
+            _cellVoxels.resize(newId + 1);
+        _voxelSlots[i] = _cellVoxels[newId].size();
+        _cellVoxels[newId].push_back(i);
+    }
+}
 
 void Lattice3d::resetType(int cellId, int type) {
-    for (int x = 0; x < _dimension; x++) {
-        for (int y = 0; y < _dimension; y++) {
-            for (int z = 0; z < _dimension; z++) {
-                auto p = getPoint(x, y, z);
-                if (p.cellId == cellId) {
-                    setPoint(cellId, x, y, z, p.act, type);
-                }
-            }
+    setCellType(cellId, type);
+}
+
+// Gives a cell its type, which all of its voxels take on at once, as
+// voxels only hold the cell id. Kept neighbour type counts are moved over
+// the voxels of the cell. Medium is always of type 0.
+void Lattice3d::setCellType(int cellId, int type) {
+    if (cellId == 0)
+        return;
+    if (cellId >= (int)_cellTypes.size()) {
+        _cellTypes.resize(cellId + 1, 0);
+        _cellTypes[cellId] = type;
+        return;
+    }
+    int oldType = _cellTypes[cellId];
+    if (oldType == type)
+        return;
+    _cellTypes[cellId] = type;
+    if (_typeCounts) {
+        for (int i: getCellVoxels(cellId)) {
+            auto p = getPoint(i);
+            moveTypeCount(p.x, p.y, p.z, oldType, type);
         }
     }
 }
 
+int Lattice3d::getCellType(int cellId) {
+    return cellId < (int)_cellTypes.size() ? _cellTypes[cellId] : 0;
+}
+
+// Types by cell id, starting with medium.
+const vector<char>& Lattice3d::getCellTypes() {
+    return _cellTypes;
+}
+
 void Lattice3d::setPoints(int id, const vector<vec3>& points, int type) {
     for (auto point: points) {
-        auto act = _actValues[index(point.x, point.y, point.z)];
+        auto act = _actValues ? 
+            _actValues[index(point.x, point.y, point.z)] : 0;
         setPoint(id, point.x, point.y, point.z, act, type);
     }
     for (auto point: points) {
@@ -206,36 +641,31 @@ void Lattice3d::setPoints(int id, const vector<vec3>& points, int type) {
     }
 }
 
+// Turns the voxels of a cell into medium. Its cell state is left to the
+// caller, see Cpm::killCell.
 void Lattice3d::remove(int id) {
-    //FIX: border tracking
-    for (int i = 0; i < _dimension * _dimension * _dimension; i++) {
-        auto currentId = _cellIds[i] % (1<<24);
-        if (currentId == id) {
-            _cellIds[i] = 0;
-        }
+    auto voxels = getCellVoxels(id);
+    for (int i: voxels) {
+        auto p = getPoint(i);
+        writeVoxel(p.x, p.y, p.z, 0, getAct(p));
+        updateBorderTrackingAround(p.x, p.y, p.z);
+        moveCellVoxel(i, id, 0);
     }
 }
 
-
 Point Lattice3d::getCenterOfMass(int id) {
     double comX = 0;
     double comY = 0;
     double comZ = 0;
-    int count = 0;
-    for (int x = 0; x < _dimension; x++) {
-        for (int y = 0; y < _dimension; y++) {
-            for (int z = 0; z < _dimension; z++) {
-                auto p = getPoint(x, y, z);
-                if (p.cellId == id) {
-                    comX += x;
-                    comY += y;
-                    comZ += z;
-                    count++;
-                }
-            }
-        }
+    auto& voxels = getCellVoxels(id);
+    for (int i: voxels) {
+        auto p = getPoint(i);
+        comX += p.x;
+        comY += p.y;
+        comZ += p.z;
     }
 
+    int count = voxels.size();
     if (count > 0) {
         comX /= count;
         comY /= count;
@@ -247,10 +677,11 @@ Point Lattice3d::getCenterOfMass(int id) {
 
 
 
+const int* Lattice3d::getDirection(int i) {
+    return directions[i];
+}
+
 int Lattice3d::getNeighborCount() {
     return 26;
 }
 
-void Lattice3d::setAct(bool actToggle) {
-    _actToggle = actToggle;
-}
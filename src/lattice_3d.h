@@ -4,8 +4,11 @@
 #include <vector>
 #include <iostream>
 #include <string>
-#include "dice_set.h"
+#include <atomic>
+#include "paged_dice_set.h"
 #include "linalg.h"
+#include "boundary.h"
+#include "gradient_field.h"
 
 using namespace std;
 
@@ -22,7 +25,6 @@ class Lattice3d {
             int x;
             int y;
             int z;
-            int act;
 
             IntPoint times(int r) {
                 IntPoint a;
@@ -87,20 +89,22 @@ class Lattice3d {
                 return p;
             }
 
-            Point wrap(int dimension) {
+            // Nearest periodic image; a period of zero leaves that axis
+            // as it is.
+            Point wrap(const IntPoint& period) {
                 Point p = *this;
-                if (p.x > dimension/2)
-                    p.x -= dimension;
-                if (p.x < -dimension/2)
-                    p.x += dimension;
-                if (p.y > dimension/2)
-                    p.y -= dimension;
-                if (p.y < -dimension/2)
-                    p.y += dimension;
-                if (p.z > dimension/2)
-                    p.z -= dimension;
-                if (p.z < -dimension/2)
-                    p.z += dimension;
+                if (p.x > period.x/2)
+                    p.x -= period.x;
+                if (p.x < -period.x/2)
+                    p.x += period.x;
+                if (p.y > period.y/2)
+                    p.y -= period.y;
+                if (p.y < -period.y/2)
+                    p.y += period.y;
+                if (p.z > period.z/2)
+                    p.z -= period.z;
+                if (p.z < -period.z/2)
+                    p.z += period.z;
                 return p;
             }
 
@@ -113,9 +117,7 @@ class Lattice3d {
                 return p;
             }
 
-            void unitRandomize() {
-                random_device rng;
-                mt19937 urng(rng());
+            void unitRandomize(mt19937& urng) {
                 normal_distribution<double> distribution(0.0,1.0);
                 x = distribution(urng);
                 y = distribution(urng);
@@ -200,6 +202,31 @@ class Lattice3d {
                 return r;
             }
 
+            // The per-axis versions leave axes with a zero period alone.
+            IntPoint modulo(const IntPoint& m) {
+                IntPoint r;
+                r.x = m.x ? (x+m.x)%m.x : x;
+                r.y = m.y ? (y+m.y)%m.y : y;
+                r.z = m.z ? (z+m.z)%m.z : z;
+                return r;
+            }
+
+            IntPoint mul(const IntPoint& r) {
+                IntPoint p;
+                p.x = x * r.x;
+                p.y = y * r.y;
+                p.z = z * r.z;
+                return p;
+            }
+
+            IntPoint intDiv(const IntPoint& r) {
+                IntPoint p;
+                p.x = r.x ? x/r.x : 0;
+                p.y = r.y ? y/r.y : 0;
+                p.z = r.z ? z/r.z : 0;
+                return p;
+            }
+
             IntPoint mul(int r) {
                 IntPoint p;
                 p.x = x * r;
@@ -226,40 +253,121 @@ class Lattice3d {
         };
 
 
-        Lattice3d(int dimension);
+        static const int neighborCount = 26;
+
+        // Ids, types and act values of the neighbours of one voxel, in
+        // getNeighbor order, read in a single pass. Act values are only
+        // filled in once the lattice keeps them.
+        struct Neighborhood {
+            unsigned int cellIds[neighborCount];
+            char types[neighborCount];
+            int acts[neighborCount];
+        };
+
+        Lattice3d(IntPoint dimensions, 
+                const std::vector<Boundary>& boundaries);
         int getNeighborCount();
+        // Offset of the i-th neighbour, in getNeighbor order.
+        static const int* getDirection(int i);
         void setPoint(int cellId, int x, int y, int z, int time, int type);
         LatticePoint getPoint(int x, int y, int z);
         LatticePoint getPoint(int i);
         int size();
+        int indexCount();
+        int voxelIndex(int voxel);
+        bool contains(LatticePoint& point);
+        IntPoint period();
+        bool fitsBlocks(int blockSize);
         LatticePoint getRandomBorderLocation(ranxoshi256& xoshi);
         LatticePoint getRandomNeighbor(LatticePoint& point, ranxoshi256& xoshi);
         LatticePoint getNeighbor(LatticePoint& point, int i);
+        void getNeighborhood(LatticePoint& point, Neighborhood& neighborhood);
         LatticePoint getNeighbor(int x, int y, int z, int i);
         Point getCenterOfMass(int id);
         bool isPartOfBorder(int x, int y, int z);
         void copy(LatticePoint& source, LatticePoint& target, int time);
+        void copyValues(LatticePoint& source, LatticePoint& target, int time);
+        void finishCopy(LatticePoint& source, LatticePoint& target);
         void updateBorderTrackingAround(int x, int y, int z);
-        int index(unsigned int x, unsigned int y, unsigned int z);
+        void updateBorderTrackingAround(LatticePoint& point);
+        int blockCount(int blockSize);
+        int blockOf(int i, int blockSize);
+        int blockColor(int block, int blockSize);
+        int blockColorCount();
+        int blocksAround(LatticePoint& point, int radius, int blockSize, 
+                int* blocks);
+        void sitesAround(LatticePoint& point, int radius, 
+                std::vector<int>& sites);
+        int index(int x, int y, int z);
+        int index(LatticePoint& point);
         std::vector<vec3> getPoints(int cellId);
+        const std::vector<int>& getCellVoxels(int cellId);
         void setPoints(int id, const std::vector<vec3>& points, int type);
         unsigned int* getCellIds();
+        int* getActValues();
+        int stride(int axis);
         void resetType(int cellId, int type);
+        void setCellType(int cellId, int type);
+        int getCellType(int cellId);
+        const std::vector<char>& getCellTypes();
         void remove(int id);
         Point getFieldPoint(LatticePoint& point);
-        void setAct(bool actToggle);
+        void allocateActValues();
+        GradientField& getField();
+        int getAct(LatticePoint& point);
+        void keepTypeCounts(int numberOfTypes);
+        const unsigned char* getTypeCounts(LatticePoint& point);
+        void releaseEmptyBricks();
         ~Lattice3d();
 
-        DiceSet _borderIndices;
+        PagedDiceSet _borderIndices;
+        // Cell id of every voxel, 0 for medium. Types are kept per cell.
         unsigned int* _cellIds;
+        std::vector<char> _cellTypes;
+        // Number of neighbours of each voxel belonging to another cell; a
+        // voxel is on the border exactly when its count is nonzero.
+        unsigned char* _foreignCounts;
+        // Number of neighbours of each voxel of every type but medium, with
+        // _countedTypes entries per voxel, or null while not kept.
+        unsigned char* _typeCounts;
+        int _countedTypes;
+        // Indices of the voxels of each cell, by cell id, and the position
+        // of every cell voxel in its cell's list. Null and empty until the
+        // first per-cell query builds them.
+        std::vector<std::vector<int>> _cellVoxels;
+        int* _voxelSlots;
+        // Act values are only allocated once something uses them, and are
+        // null until then; the field allocates its own values lazily.
         int* _actValues;
-        double* _field;
-        const int _dimension;
-
-        bool _actToggle;
+        GradientField* _field;
+        // Extent along each axis, halo excluded.
+        IntPoint _dimensions;
+        Boundary _boundaries[3];
 
 
     private:
+        void writeVoxel(int x, int y, int z, unsigned int id, int act);
+        int neighborIndex(int x, int y, int z, int i);
+        void updateBorderTracking(int i);
+        int wrap(int coordinate, int axis);
+        bool contains(int x, int y, int z);
+        void moveTypeCount(int x, int y, int z, int oldType, int newType);
+        void indexCellVoxels();
+        void moveCellVoxel(int i, unsigned int oldId, unsigned int newId);
+        bool isUsed(int i);
+        void trackUse(int i, bool wasUsed);
+        void markWritten(int i);
+        int brickCount();
+        const int _rowStride;
+        const int _planeStride;
+        int _offsets[26];
+        // The arrays are split into bricks of consecutive indices that only
+        // take memory once written to. _brickUse counts the voxels of each
+        // brick that hold or border a cell; written bricks without any are
+        // handed back by releaseEmptyBricks().
+        static const int brickBits = 12;
+        std::atomic<int>* _brickUse;
+        std::atomic<bool>* _brickWritten;
 }; 
 
 #endif // LATTICE_H_
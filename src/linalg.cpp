@@ -1,9 +1,10 @@
 #include "linalg.h"
 #include <math.h>
+#include <algorithm>
 
 using namespace std;
 
-vec2 calculateAverage(std::vector<vec2> points) {
+vec2 calculateAverage(const std::vector<vec2>& points) {
     vec2 avg = {0,0};
     for (auto point: points) {
         avg += point;
@@ -11,7 +12,7 @@ vec2 calculateAverage(std::vector<vec2> points) {
     return avg / points.size();
 }
 
-vec3 calculateAverage(std::vector<vec3> points) {
+vec3 calculateAverage(const std::vector<vec3>& points) {
     vec3 avg = {0,0,0};
     for (auto point: points) {
         avg += point;
@@ -19,7 +20,7 @@ vec3 calculateAverage(std::vector<vec3> points) {
     return avg / points.size();
 }
 
-mat2 calculateCovarianceMatrix(std::vector<vec2> points, vec2 average) {
+mat2 calculateCovarianceMatrix(const std::vector<vec2>& points, vec2 average) {
     float xx = 0;
     float yy = 0;
     float xy = 0;
@@ -32,21 +33,112 @@ mat2 calculateCovarianceMatrix(std::vector<vec2> points, vec2 average) {
     return {xx, xy, xy, yy};
 }
 
+mat3 calculateCovarianceMatrix(const std::vector<vec3>& points, vec3 average) {
+    float xx = 0;
+    float yy = 0;
+    float zz = 0;
+    float xy = 0;
+    float xz = 0;
+    float yz = 0;
+    for (auto p: points) {
+        auto point = p - average;
+        xx += point.x * point.x;
+        yy += point.y * point.y;
+        zz += point.z * point.z;
+        xy += point.x * point.y;
+        xz += point.x * point.z;
+        yz += point.y * point.z;
+    }
+    return {xx, xy, xz, xy, yy, yz, xz, yz, zz};
+}
+
 std::vector<float> calculateEigenValues(mat2 m) {
-    float trace = m.v[1] + m.v[2];
-    float determinant = m.v[1] * m.v[2] - m.v[0] * m.v[3];
+    float trace = m.v[0] + m.v[3];
+    float determinant = m.v[0] * m.v[3] - m.v[1] * m.v[2];
 
-    float val1 = sqrt(0.25 * trace * trace - determinant) + 0.5 * trace;
-    float val2 = -sqrt(0.25 * trace * trace - determinant) + 0.5 * trace;
+    float root = sqrt(max(0.25f * trace * trace - determinant, 0.0f));
+    float val1 = root + 0.5 * trace;
+    float val2 = -root + 0.5 * trace;
     return {val1, val2};
 }
 
+// Closed form for symmetric matrices, from the characteristic polynomial
+// of (m - q I) / p with q the mean eigenvalue.
+std::vector<float> calculateEigenValues(mat3 m) {
+    float offDiagonal = m.v[1] * m.v[1] + m.v[2] * m.v[2] + m.v[5] * m.v[5];
+    if (offDiagonal == 0) {
+        vector<float> values = {m.v[0], m.v[4], m.v[8]};
+        sort(values.begin(), values.end(), greater<float>());
+        return values;
+    }
+    float q = (m.v[0] + m.v[4] + m.v[8]) / 3;
+    float a = m.v[0] - q;
+    float b = m.v[4] - q;
+    float c = m.v[8] - q;
+    float p = sqrt((a * a + b * b + c * c + 2 * offDiagonal) / 6);
+    float determinant = a * (b * c - m.v[5] * m.v[5]) 
+        - m.v[1] * (m.v[1] * c - m.v[5] * m.v[2]) 
+        + m.v[2] * (m.v[1] * m.v[5] - b * m.v[2]);
+    float r = determinant / (2 * p * p * p);
+    float phi = acos(min(max(r, -1.0f), 1.0f)) / 3;
+    float val1 = q + 2 * p * cos(phi);
+    float val3 = q + 2 * p * cos(phi + 2 * M_PI / 3);
+    float val2 = 3 * q - val1 - val3;
+    return {val1, val2, val3};
+}
+
 vec2 calculateEigenVector(mat2 m, float eigenvalue) {
     if (m.v[2] != 0) {
         return {eigenvalue - m.v[3],  m.v[2]};
     } else if (m.v[1] != 0) {
         return {m.v[1], eigenvalue - m.v[0]};
-    } else {
+    } else if (fabs(eigenvalue - m.v[0]) <= fabs(eigenvalue - m.v[3])) {
         return {1, 0};
+    } else {
+        return {0, 1};
+    }
+}
+
+static vec3 cross(vec3 a, vec3 b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, 
+        a.x * b.y - a.y * b.x};
+}
+
+// The eigenvector is orthogonal to the rows of m - eigenvalue I, so it is
+// the largest cross product of two of them. For a repeated eigenvalue the
+// rows are parallel and any vector orthogonal to them will do.
+vec3 calculateEigenVector(mat3 m, float eigenvalue) {
+    vec3 rows[3] = {{m.v[0] - eigenvalue, m.v[1], m.v[2]},
+        {m.v[3], m.v[4] - eigenvalue, m.v[5]},
+        {m.v[6], m.v[7], m.v[8] - eigenvalue}};
+    vec3 best = {0, 0, 0};
+    float bestLength = 0;
+    for (int i = 0; i < 3; i++) {
+        auto product = cross(rows[i], rows[(i + 1) % 3]);
+        float length = product.dot(product);
+        if (length > bestLength) {
+            best = product;
+            bestLength = length;
+        }
+    }
+    float scale = 0;
+    vec3 row = rows[0];
+    for (auto r: rows) {
+        if (r.dot(r) > scale) {
+            scale = r.dot(r);
+            row = r;
+        }
     }
+    if (bestLength > 1e-6f * scale * scale)
+        return best.normalize();
+    if (scale == 0)
+        return {1, 0, 0};
+    vec3 axis = {0, 0, 0};
+    if (fabs(row.x) <= fabs(row.y) && fabs(row.x) <= fabs(row.z))
+        axis.x = 1;
+    else if (fabs(row.y) <= fabs(row.z))
+        axis.y = 1;
+    else
+        axis.z = 1;
+    return cross(row, axis).normalize();
 }
@@ -93,10 +93,19 @@ struct mat2 {
     float v[4];
 };
 
-vec2 calculateAverage(std::vector<vec2> points);
-vec3 calculateAverage(std::vector<vec3> points);
-mat2 calculateCovarianceMatrix(std::vector<vec2> points, vec2 average);
-vec2 calculateEigenVector(mat2 m, float eigenvalue);
+// Row major.
+struct mat3 {
+    float v[9];
+};
+
+vec2 calculateAverage(const std::vector<vec2>& points);
+vec3 calculateAverage(const std::vector<vec3>& points);
+mat2 calculateCovarianceMatrix(const std::vector<vec2>& points, vec2 average);
+mat3 calculateCovarianceMatrix(const std::vector<vec3>& points, vec3 average);
+// Eigenvalues of symmetric matrices, largest first.
 std::vector<float> calculateEigenValues(mat2 m);
+std::vector<float> calculateEigenValues(mat3 m);
+vec2 calculateEigenVector(mat2 m, float eigenvalue);
+vec3 calculateEigenVector(mat3 m, float eigenvalue);
 
 #endif // LINALG_H_
@@ -0,0 +1,66 @@
+#include <cstdlib>
+#include "local_connectivity.h"
+#include "sparse_memory.h"
+#include "lattice.h"
+
+using namespace std;
+
+static_assert(sizeof(atomic<unsigned char>) == 1 && 
+        atomic<unsigned char>::is_always_lock_free,
+        "the connectivity table is read as plain zeroed bytes");
+
+LocalConnectivity::LocalConnectivity(int neighborCount, int dimension,
+        const int* (*direction)(int)): _neighborCount(neighborCount) {
+    for (int i = 0; i < neighborCount; i++) {
+        _faceNeighbors[i] = 0;
+        for (int j = 0; j < neighborCount; j++) {
+            int distance = 0;
+            for (int axis = 0; axis < dimension; axis++)
+                distance += abs(direction(i)[axis] - direction(j)[axis]);
+            if (distance == 1)
+                _faceNeighbors[i] |= 1u << j;
+        }
+    }
+    _tableSize = size_t(1) << neighborCount;
+    _table = reinterpret_cast<atomic<unsigned char>*>(
+            allocateSparse(_tableSize));
+    if (neighborCount <= 8) {
+        for (uint32_t pattern = 0; pattern < _tableSize; pattern++)
+            _table[pattern].store(computeEntry(pattern));
+    }
+}
+
+LocalConnectivity::~LocalConnectivity() {
+    freeSparse(_table, _tableSize);
+}
+
+// Grows the piece holding the lowest voxel of the pattern one face step at
+// a time, with all voxels of the front handled together as bits.
+unsigned char LocalConnectivity::computeEntry(uint32_t pattern) {
+    if (pattern == 0)
+        return simple;
+    uint32_t piece = pattern & -pattern;
+    uint32_t front = piece;
+    while (front) {
+        uint32_t reached = 0;
+        for (uint32_t bits = front; bits; bits &= bits - 1)
+            reached |= _faceNeighbors[__builtin_ctz(bits)];
+        front = reached & pattern & ~piece;
+        piece |= front;
+    }
+    return piece == pattern ? simple : split;
+}
+
+template <>
+LocalConnectivity& localConnectivity<Lattice2d>() {
+    static LocalConnectivity connectivity(Lattice2d::neighborCount, 2,
+            Lattice2d::getDirection);
+    return connectivity;
+}
+
+template <>
+LocalConnectivity& localConnectivity<Lattice3d>() {
+    static LocalConnectivity connectivity(Lattice3d::neighborCount, 3,
+            Lattice3d::getDirection);
+    return connectivity;
+}
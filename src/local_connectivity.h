@@ -0,0 +1,48 @@
+#ifndef LOCAL_CONNECTIVITY_H_
+#define LOCAL_CONNECTIVITY_H_
+
+#include <atomic>
+#include <cstdint>
+
+// Tells whether taking a voxel away from a cell leaves the cell connected
+// around it. The cell's voxels among the neighbours of the voxel are given
+// as a bit pattern in neighbour order, and the voxel is simple for the
+// cell when they form a single piece of face-adjacent voxels within the
+// neighbourhood. On the 8-ring this is one arc of the cell around the voxel;
+// in 3D it replaces any walk along the 26 neighbours, whose order has no
+// topological meaning.
+//
+// The answers are kept in a table with one entry per pattern. The 256 ring
+// patterns are filled in up front; the 2^26 patterns of 3D are filled in
+// as they are first met, in sparse memory, so only the pages of patterns
+// that occur take up RAM. Threads filling in the same entry write the same
+// answer.
+class LocalConnectivity {
+    public:
+        LocalConnectivity(int neighborCount, int dimension,
+                const int* (*direction)(int));
+        ~LocalConnectivity();
+        bool isSimple(uint32_t pattern) {
+            unsigned char entry = 
+                _table[pattern].load(std::memory_order_relaxed);
+            if (entry == unknown) {
+                entry = computeEntry(pattern);
+                _table[pattern].store(entry, std::memory_order_relaxed);
+            }
+            return entry == simple;
+        }
+    private:
+        enum Entry : unsigned char { unknown = 0, simple = 1, split = 2 };
+        unsigned char computeEntry(uint32_t pattern);
+        int _neighborCount;
+        // Neighbours sharing a face with each neighbour, as bit patterns.
+        uint32_t _faceNeighbors[32];
+        std::atomic<unsigned char>* _table;
+        size_t _tableSize;
+};
+
+// One table per lattice type, shared by all simulations.
+template <typename L>
+LocalConnectivity& localConnectivity();
+
+#endif // LOCAL_CONNECTIVITY_H_
@@ -0,0 +1,320 @@
+#include <cmath>
+#include <algorithm>
+#include "multigrid.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// Grids stop shrinking once they are this small, and are then smoothed
+// until converged.
+static const size_t coarsestSize = 512;
+static const int coarsestSweeps = 50;
+static const int smoothingSweeps = 2;
+static const double jacobiWeight = 2.0 / 3.0;
+
+Multigrid::Multigrid(const int* dimensions, const int* period) {
+    Level level;
+    for (int axis = 0; axis < 3; axis++) {
+        level.dimensions[axis] = dimensions[axis];
+        level.periodic[axis] = period[axis] > 0;
+        level.widths[axis].assign(dimensions[axis], 1.0);
+    }
+    while (true) {
+        level.size = (size_t)level.dimensions[0] * level.dimensions[1] *
+            level.dimensions[2];
+        bool halves = false;
+        for (int axis = 0; axis < 3; axis++) {
+            level.halved[axis] = level.dimensions[axis] > 1;
+            halves = halves || level.halved[axis];
+        }
+        if (level.size <= coarsestSize || !halves) {
+            for (int axis = 0; axis < 3; axis++)
+                level.halved[axis] = false;
+            _levels.push_back(level);
+            break;
+        }
+        _levels.push_back(level);
+        for (int axis = 0; axis < 3; axis++) {
+            if (!level.halved[axis])
+                continue;
+            const vector<double> widths = level.widths[axis];
+            const int n = level.dimensions[axis];
+            level.dimensions[axis] = (n + 1) / 2;
+            level.widths[axis].resize(level.dimensions[axis]);
+            for (int i = 0; i < level.dimensions[axis]; i++)
+                level.widths[axis][i] = widths[2 * i] +
+                    (2 * i + 1 < n ? widths[2 * i + 1] : 0);
+        }
+    }
+    for (auto& level: _levels) {
+        level.solution.resize(level.size);
+        level.rhs.resize(level.size);
+        level.loss.resize(level.size);
+        level.residual.resize(level.size);
+        level.scratch.resize(level.size);
+        for (int axis = 0; axis < 3; axis++) {
+            level.lower[axis].resize(level.dimensions[axis]);
+            level.upper[axis].resize(level.dimensions[axis]);
+        }
+    }
+}
+
+// Improves solution in place until the largest residual falls below
+// tolerance times the largest production, and returns the number of
+// V-cycles taken.
+int Multigrid::solve(double* solution, const double* production,
+        const double* loss, double diffusion, double tolerance,
+        int maxCycles, ThreadPool& pool) {
+    Level& top = _levels[0];
+    copy(solution, solution + top.size, top.solution.begin());
+    copy(production, production + top.size, top.rhs.begin());
+    copy(loss, loss + top.size, top.loss.begin());
+    for (size_t l = 0; l < _levels.size(); l++) {
+        Level& level = _levels[l];
+        // The flux to a neighbour falls with the distance between the
+        // centres, and is spread over the width of the node.
+        for (int axis = 0; axis < 3; axis++) {
+            const vector<double>& widths = level.widths[axis];
+            for (int i = 0; i < level.dimensions[axis]; i++) {
+                int below = neighbor(level, i, -1, axis);
+                int above = neighbor(level, i, 1, axis);
+                level.lower[axis][i] = below == i ? 0 : diffusion /
+                    (widths[i] * 0.5 * (widths[i] + widths[below]));
+                level.upper[axis][i] = above == i ? 0 : diffusion /
+                    (widths[i] * 0.5 * (widths[i] + widths[above]));
+            }
+        }
+        if (l > 0)
+            restrictTo(_levels[l - 1], _levels[l], _levels[l - 1].loss,
+                    _levels[l].loss, pool);
+    }
+    double scale = 0;
+    for (size_t i = 0; i < top.size; i++)
+        scale = max(scale, fabs(production[i]));
+    int cycles = 0;
+    while (cycles < maxCycles &&
+            computeResidual(top, pool) > tolerance * scale) {
+        cycle(0, pool);
+        cycles++;
+    }
+    copy(top.solution.begin(), top.solution.end(), solution);
+    return cycles;
+}
+
+// Past a wall the neighbour is the node itself, which leaves no flux.
+int Multigrid::neighbor(const Level& level, int coordinate, int step,
+        int axis) {
+    int next = coordinate + step;
+    int n = level.dimensions[axis];
+    if (next >= 0 && next < n)
+        return next;
+    if (!level.periodic[axis])
+        return coordinate;
+    return (next + n) % n;
+}
+
+// The coupling weighted sum of the neighbours of every node in a row, and
+// the total coupling of each node.
+void Multigrid::neighborSum(const Level& level, int row, double* sum,
+        double* diagonal) {
+    const int width = level.dimensions[0];
+    const int p[3] = {0, row % level.dimensions[1], row / level.dimensions[1]};
+    const double* c = level.solution.data() + (size_t)row * width;
+    const double* lower = level.lower[0].data();
+    const double* upper = level.upper[0].data();
+    if (width == 1) {
+        sum[0] = 0;
+    } else {
+        for (int x = 1; x < width - 1; x++)
+            sum[x] = lower[x] * c[x - 1] + upper[x] * c[x + 1];
+        sum[0] = lower[0] * c[neighbor(level, 0, -1, 0)] + upper[0] * c[1];
+        sum[width - 1] = lower[width - 1] * c[width - 2] +
+            upper[width - 1] * c[neighbor(level, width - 1, 1, 0)];
+    }
+    double other = 0;
+    for (int axis = 1; axis < 3; axis++) {
+        const double couplings[2] = {level.lower[axis][p[axis]],
+            level.upper[axis][p[axis]]};
+        for (int side = 0; side < 2; side++) {
+            if (couplings[side] == 0)
+                continue;
+            int q[3] = {0, p[1], p[2]};
+            q[axis] = neighbor(level, p[axis], side ? 1 : -1, axis);
+            const double* c2 = level.solution.data() +
+                ((size_t)q[2] * level.dimensions[1] + q[1]) * width;
+            for (int x = 0; x < width; x++)
+                sum[x] += couplings[side] * c2[x];
+            other += couplings[side];
+        }
+    }
+    for (int x = 0; x < width; x++)
+        diagonal[x] = lower[x] + upper[x] + other;
+}
+
+// Weighted Jacobi sweeps.
+void Multigrid::smooth(Level& level, int sweeps, ThreadPool& pool) {
+    const int width = level.dimensions[0];
+    for (int sweep = 0; sweep < sweeps; sweep++) {
+        pool.runRanges(level.dimensions[1] * level.dimensions[2],
+                [&](int begin, int end) {
+            vector<double> sum(width);
+            vector<double> diagonal(width);
+            for (int row = begin; row < end; row++) {
+                neighborSum(level, row, sum.data(), diagonal.data());
+                const size_t offset = (size_t)row * width;
+                const double* c = &level.solution[offset];
+                const double* rhs = &level.rhs[offset];
+                const double* loss = &level.loss[offset];
+                double* out = &level.scratch[offset];
+                for (int x = 0; x < width; x++)
+                    out[x] = (1 - jacobiWeight) * c[x] + jacobiWeight *
+                        (rhs[x] + sum[x]) / (loss[x] + diagonal[x]);
+            }
+        });
+        swap(level.solution, level.scratch);
+    }
+}
+
+// Stores rhs - A solution in residual and returns its largest magnitude.
+double Multigrid::computeResidual(Level& level, ThreadPool& pool) {
+    const int width = level.dimensions[0];
+    vector<double> largest(pool.size());
+    pool.run([&](int worker) {
+        int rows = level.dimensions[1] * level.dimensions[2];
+        int begin = (long long)rows * worker / pool.size();
+        int end = (long long)rows * (worker + 1) / pool.size();
+        vector<double> sum(width);
+        vector<double> diagonal(width);
+        for (int row = begin; row < end; row++) {
+            neighborSum(level, row, sum.data(), diagonal.data());
+            const size_t offset = (size_t)row * width;
+            const double* c = &level.solution[offset];
+            const double* rhs = &level.rhs[offset];
+            const double* loss = &level.loss[offset];
+            double* out = &level.residual[offset];
+            double rowLargest = 0;
+            for (int x = 0; x < width; x++) {
+                out[x] = rhs[x] + sum[x] - (loss[x] + diagonal[x]) * c[x];
+                rowLargest = max(rowLargest, fabs(out[x]));
+            }
+            largest[worker] = max(largest[worker], rowLargest);
+        }
+    });
+    return *max_element(largest.begin(), largest.end());
+}
+
+// Each coarse node takes the mean of the fine nodes it covers, weighted by
+// their volume.
+void Multigrid::restrictTo(Level& fine, Level& coarse,
+        const vector<double>& from, vector<double>& to, ThreadPool& pool) {
+    const int width = coarse.dimensions[0];
+    int spans[3];
+    for (int axis = 0; axis < 3; axis++)
+        spans[axis] = fine.halved[axis] ? 2 : 1;
+    const vector<double>& fineWidths = fine.widths[0];
+    pool.runRanges(coarse.dimensions[1] * coarse.dimensions[2],
+            [&](int begin, int end) {
+        for (int row = begin; row < end; row++) {
+            int y = row % coarse.dimensions[1];
+            int z = row / coarse.dimensions[1];
+            double* out = &to[(size_t)row * width];
+            fill(out, out + width, 0.0);
+            for (int fz = z * spans[2]; fz < min((z + 1) * spans[2],
+                        fine.dimensions[2]); fz++) {
+                for (int fy = y * spans[1]; fy < min((y + 1) * spans[1],
+                            fine.dimensions[1]); fy++) {
+                    const double area = fine.widths[1][fy] *
+                        fine.widths[2][fz];
+                    const double* in = &from[((size_t)fz *
+                            fine.dimensions[1] + fy) * fine.dimensions[0]];
+                    for (int x = 0; x < width; x++) {
+                        int fx = x * spans[0];
+                        double value = fineWidths[fx] * in[fx];
+                        if (spans[0] == 2 && fx + 1 < fine.dimensions[0])
+                            value += fineWidths[fx + 1] * in[fx + 1];
+                        out[x] += area * value;
+                    }
+                }
+            }
+            const double area = coarse.widths[1][y] * coarse.widths[2][z];
+            for (int x = 0; x < width; x++)
+                out[x] /= area * coarse.widths[0][x];
+        }
+    });
+}
+
+// Along an axis, the coarse node covering a fine one, the next coarse node
+// on the side of the fine one, and the weight of the first when
+// interpolating linearly between their centres.
+void Multigrid::interpolation(const Level& fine, const Level& coarse,
+        int i, int axis, int& near, int& far, double& weight) {
+    if (!fine.halved[axis]) {
+        near = far = i;
+        weight = 1;
+        return;
+    }
+    near = i / 2;
+    far = neighbor(coarse, near, i % 2 ? 1 : -1, axis);
+    // The fine centre lies half the width of its sibling from the coarse
+    // centre, and a lone fine node sits right on it.
+    int sibling = i % 2 ? i - 1 : i + 1;
+    double offset = sibling < fine.dimensions[axis] ?
+        0.5 * fine.widths[axis][sibling] : 0;
+    const vector<double>& widths = coarse.widths[axis];
+    weight = far == near ? 1 :
+        1 - offset / (0.5 * (widths[near] + widths[far]));
+}
+
+// Adds the coarse solution, interpolated linearly, to the fine one.
+void Multigrid::prolongFrom(Level& coarse, Level& fine, ThreadPool& pool) {
+    const int width = fine.dimensions[0];
+    vector<int> nearX(width);
+    vector<int> farX(width);
+    vector<double> weightX(width);
+    for (int x = 0; x < width; x++)
+        interpolation(fine, coarse, x, 0, nearX[x], farX[x], weightX[x]);
+    pool.runRanges(fine.dimensions[1] * fine.dimensions[2],
+            [&](int begin, int end) {
+        for (int row = begin; row < end; row++) {
+            const int p[3] = {0, row % fine.dimensions[1],
+                row / fine.dimensions[1]};
+            int near[3];
+            int far[3];
+            double weights[3];
+            for (int axis = 1; axis < 3; axis++)
+                interpolation(fine, coarse, p[axis], axis, near[axis],
+                        far[axis], weights[axis]);
+            double* out = &fine.solution[(size_t)row * width];
+            for (int corner = 0; corner < 4; corner++) {
+                bool farY = corner & 1;
+                bool farZ = corner & 2;
+                double weight = (farY ? 1 - weights[1] : weights[1]) *
+                    (farZ ? 1 - weights[2] : weights[2]);
+                if (weight == 0)
+                    continue;
+                const double* in = &coarse.solution[((size_t)(farZ ?
+                                far[2] : near[2]) * coarse.dimensions[1] +
+                            (farY ? far[1] : near[1])) * coarse.dimensions[0]];
+                for (int x = 0; x < width; x++)
+                    out[x] += weight * (weightX[x] * in[nearX[x]] +
+                            (1 - weightX[x]) * in[farX[x]]);
+            }
+        }
+    });
+}
+
+void Multigrid::cycle(int index, ThreadPool& pool) {
+    Level& level = _levels[index];
+    if (index + 1 == (int)_levels.size()) {
+        smooth(level, coarsestSweeps, pool);
+        return;
+    }
+    Level& coarse = _levels[index + 1];
+    smooth(level, smoothingSweeps, pool);
+    computeResidual(level, pool);
+    restrictTo(level, coarse, level.residual, coarse.rhs, pool);
+    fill(coarse.solution.begin(), coarse.solution.end(), 0);
+    cycle(index + 1, pool);
+    prolongFrom(coarse, level, pool);
+    smooth(level, smoothingSweeps, pool);
+}
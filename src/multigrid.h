@@ -0,0 +1,56 @@
+#ifndef MULTIGRID_H_
+#define MULTIGRID_H_
+
+#include <vector>
+#include <cstddef>
+
+class ThreadPool;
+
+// Solves the steady state of a chemokine,
+//     diffusion * laplace(c) - loss * c + production = 0,
+// on a grid with unit spacing, with V-cycles over successively halved grids.
+// Walls have no flux through them. The loss has to be positive somewhere
+// for the steady state to exist.
+class Multigrid {
+    public:
+        Multigrid(const int* dimensions, const int* period);
+        int solve(double* solution, const double* production,
+                const double* loss, double diffusion, double tolerance,
+                int maxCycles, ThreadPool& pool);
+    private:
+        // Nodes are cells of the grid, each coarser node covering two finer
+        // ones along every axis with more than one node, and the last node
+        // only one along odd axes. Widths are in nodes of the finest grid,
+        // and lower and upper couple a node to its neighbours along an axis,
+        // which lets the coarse grids balance fluxes across uneven cells.
+        struct Level {
+            int dimensions[3];
+            bool periodic[3];
+            bool halved[3];
+            std::vector<double> widths[3];
+            std::vector<double> lower[3];
+            std::vector<double> upper[3];
+            size_t size;
+            std::vector<double> solution;
+            std::vector<double> rhs;
+            std::vector<double> loss;
+            std::vector<double> residual;
+            std::vector<double> scratch;
+        };
+        int neighbor(const Level& level, int coordinate, int step,
+                int axis);
+        void neighborSum(const Level& level, int row, double* sum,
+                double* diagonal);
+        void smooth(Level& level, int sweeps, ThreadPool& pool);
+        double computeResidual(Level& level, ThreadPool& pool);
+        void restrictTo(Level& fine, Level& coarse,
+                const std::vector<double>& from, std::vector<double>& to,
+                ThreadPool& pool);
+        void interpolation(const Level& fine, const Level& coarse, int i,
+                int axis, int& near, int& far, double& weight);
+        void prolongFrom(Level& coarse, Level& fine, ThreadPool& pool);
+        void cycle(int level, ThreadPool& pool);
+        std::vector<Level> _levels;
+};
+
+#endif // MULTIGRID_H_
@@ -0,0 +1,197 @@
+#include <cstring>
+#include "neighbor_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NEIGHBOR_KERNELS_X86
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+static void countMatchesScalar(const unsigned int* ids, int count,
+        unsigned int a, unsigned int b, int* matchesA, int* matchesB) {
+    int countA = 0;
+    int countB = 0;
+    for (int i = 0; i < count; i++) {
+        countA += ids[i] == a;
+        countB += ids[i] == b;
+    }
+    *matchesA = countA;
+    *matchesB = countB;
+}
+
+static int adhesionDeltaScalar(const unsigned int* ids, const char* types,
+        int count, unsigned int sourceId, unsigned int targetId,
+        const int* sourceColumn, const int* targetColumn, int stride) {
+    int previousAdhesion = 0;
+    int nextAdhesion = 0;
+    for (int i = 0; i < count; i++) {
+        const int row = types[i] * stride;
+        previousAdhesion += (ids[i] != targetId) * targetColumn[row];
+        nextAdhesion += (ids[i] != sourceId) * sourceColumn[row];
+    }
+    return nextAdhesion - previousAdhesion;
+}
+
+static const NeighborKernels scalarKernels = {
+    "scalar", countMatchesScalar, adhesionDeltaScalar
+};
+
+#ifdef NEIGHBOR_KERNELS_X86
+
+// Lanes past the end of the neighbourhood are masked off, both in the loads
+// and in the gathers.
+__attribute__((target("avx2")))
+static inline __m256i laneMaskAvx2(int remaining) {
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(remaining),
+            _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i loadTypesAvx2(const char* types, int remaining) {
+    char lanes[8] = {0};
+    memcpy(lanes, types, remaining < 8 ? remaining : 8);
+    return _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)lanes));
+}
+
+__attribute__((target("avx2,popcnt")))
+static void countMatchesAvx2(const unsigned int* ids, int count,
+        unsigned int a, unsigned int b, int* matchesA, int* matchesB) {
+    const __m256i vectorA = _mm256_set1_epi32(a);
+    const __m256i vectorB = _mm256_set1_epi32(b);
+    int countA = 0;
+    int countB = 0;
+    for (int i = 0; i < count; i += 8) {
+        const __m256i mask = laneMaskAvx2(count - i);
+        const __m256i values = _mm256_maskload_epi32((const int*)ids + i, mask);
+        const int lanes = _mm256_movemask_ps(_mm256_castsi256_ps(mask));
+        countA += __builtin_popcount(lanes & _mm256_movemask_ps(
+                    _mm256_castsi256_ps(_mm256_cmpeq_epi32(values, vectorA))));
+        countB += __builtin_popcount(lanes & _mm256_movemask_ps(
+                    _mm256_castsi256_ps(_mm256_cmpeq_epi32(values, vectorB))));
+    }
+    *matchesA = countA;
+    *matchesB = countB;
+}
+
+__attribute__((target("avx2")))
+static int adhesionDeltaAvx2(const unsigned int* ids, const char* types,
+        int count, unsigned int sourceId, unsigned int targetId,
+        const int* sourceColumn, const int* targetColumn, int stride) {
+    const __m256i source = _mm256_set1_epi32(sourceId);
+    const __m256i target = _mm256_set1_epi32(targetId);
+    const __m256i rowStride = _mm256_set1_epi32(stride);
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < count; i += 8) {
+        const __m256i mask = laneMaskAvx2(count - i);
+        const __m256i values = _mm256_maskload_epi32((const int*)ids + i, mask);
+        const __m256i rows = _mm256_mullo_epi32(
+                loadTypesAvx2(types + i, count - i), rowStride);
+        const __m256i notSource = _mm256_andnot_si256(
+                _mm256_cmpeq_epi32(values, source), mask);
+        const __m256i notTarget = _mm256_andnot_si256(
+                _mm256_cmpeq_epi32(values, target), mask);
+        sum = _mm256_add_epi32(sum, _mm256_mask_i32gather_epi32(
+                    _mm256_setzero_si256(), sourceColumn, rows, notSource, 4));
+        sum = _mm256_sub_epi32(sum, _mm256_mask_i32gather_epi32(
+                    _mm256_setzero_si256(), targetColumn, rows, notTarget, 4));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum),
+            _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+    return _mm_cvtsi128_si32(half);
+}
+
+static const NeighborKernels avx2Kernels = {
+    "avx2", countMatchesAvx2, adhesionDeltaAvx2
+};
+
+__attribute__((target("avx512f")))
+static inline __mmask16 laneMaskAvx512(int remaining) {
+    return remaining < 16 ? (__mmask16)((1 << remaining) - 1) : 0xFFFF;
+}
+
+__attribute__((target("avx512f,popcnt")))
+static void countMatchesAvx512(const unsigned int* ids, int count,
+        unsigned int a, unsigned int b, int* matchesA, int* matchesB) {
+    const __m512i vectorA = _mm512_set1_epi32(a);
+    const __m512i vectorB = _mm512_set1_epi32(b);
+    int countA = 0;
+    int countB = 0;
+    for (int i = 0; i < count; i += 16) {
+        const __mmask16 mask = laneMaskAvx512(count - i);
+        const __m512i values = _mm512_maskz_loadu_epi32(mask, ids + i);
+        countA += __builtin_popcount(
+                _mm512_mask_cmpeq_epu32_mask(mask, values, vectorA));
+        countB += __builtin_popcount(
+                _mm512_mask_cmpeq_epu32_mask(mask, values, vectorB));
+    }
+    *matchesA = countA;
+    *matchesB = countB;
+}
+
+// A 16 lane gather of the adhesion table measured slower than two 8 lane
+// ones, so adhesion stays on AVX2.
+static const NeighborKernels avx512Kernels = {
+    "avx512", countMatchesAvx512, adhesionDeltaAvx2
+};
+
+#endif // NEIGHBOR_KERNELS_X86
+
+#if defined(__ARM_NEON)
+
+// NEON has no gather, so adhesion keeps the scalar table lookups.
+static void countMatchesNeon(const unsigned int* ids, int count,
+        unsigned int a, unsigned int b, int* matchesA, int* matchesB) {
+    const uint32x4_t vectorA = vdupq_n_u32(a);
+    const uint32x4_t vectorB = vdupq_n_u32(b);
+    uint32x4_t sumA = vdupq_n_u32(0);
+    uint32x4_t sumB = vdupq_n_u32(0);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const uint32x4_t values = vld1q_u32(ids + i);
+        sumA = vsubq_u32(sumA, vceqq_u32(values, vectorA));
+        sumB = vsubq_u32(sumB, vceqq_u32(values, vectorB));
+    }
+    int countA = vgetq_lane_u32(sumA, 0) + vgetq_lane_u32(sumA, 1) +
+        vgetq_lane_u32(sumA, 2) + vgetq_lane_u32(sumA, 3);
+    int countB = vgetq_lane_u32(sumB, 0) + vgetq_lane_u32(sumB, 1) +
+        vgetq_lane_u32(sumB, 2) + vgetq_lane_u32(sumB, 3);
+    for (; i < count; i++) {
+        countA += ids[i] == a;
+        countB += ids[i] == b;
+    }
+    *matchesA = countA;
+    *matchesB = countB;
+}
+
+static const NeighborKernels neonKernels = {
+    "neon", countMatchesNeon, adhesionDeltaScalar
+};
+
+#endif // __ARM_NEON
+
+// From the narrowest to the widest; the scalar kernels always come first.
+vector<const NeighborKernels*> supportedNeighborKernels() {
+    vector<const NeighborKernels*> kernels = {&scalarKernels};
+#ifdef NEIGHBOR_KERNELS_X86
+    if (__builtin_cpu_supports("avx2"))
+        kernels.push_back(&avx2Kernels);
+    if (__builtin_cpu_supports("avx512f"))
+        kernels.push_back(&avx512Kernels);
+#endif
+#if defined(__ARM_NEON)
+    kernels.push_back(&neonKernels);
+#endif
+    return kernels;
+}
+
+const NeighborKernels& neighborKernels() {
+    static const NeighborKernels& kernels = *supportedNeighborKernels().back();
+    return kernels;
+}
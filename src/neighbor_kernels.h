@@ -0,0 +1,25 @@
+#ifndef NEIGHBOR_KERNELS_H_
+#define NEIGHBOR_KERNELS_H_
+
+#include <vector>
+
+// Loops over a gathered neighbourhood (see Lattice3d::Neighborhood) that the
+// energy terms share. Every variant does the same integer arithmetic, so
+// all of them give identical results; neighborKernels() picks the widest
+// one the host supports the first time it is called.
+struct NeighborKernels {
+    const char* name;
+    // Number of ids equal to a and to b.
+    void (*countMatches)(const unsigned int* ids, int count, unsigned int a,
+            unsigned int b, int* matchesA, int* matchesB);
+    // Adhesion after minus before replacing targetId by sourceId, where
+    // the adhesion with a neighbour of type t is column[t * stride].
+    int (*adhesionDelta)(const unsigned int* ids, const char* types,
+            int count, unsigned int sourceId, unsigned int targetId,
+            const int* sourceColumn, const int* targetColumn, int stride);
+};
+
+const NeighborKernels& neighborKernels();
+std::vector<const NeighborKernels*> supportedNeighborKernels();
+
+#endif // NEIGHBOR_KERNELS_H_
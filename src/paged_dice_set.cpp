@@ -0,0 +1,53 @@
+#include "paged_dice_set.h"
+
+using namespace std;
+
+PagedDiceSet::PagedDiceSet(int capacity): 
+    _pages((capacity + pageSize - 1) / pageSize) {
+}
+
+void PagedDiceSet::add(int element) {
+    auto& page = _pages[element >> pageBits];
+    if (!page) {
+        page.reset(new int[pageSize]);
+        for (int i = 0; i < pageSize; i++)
+            page[i] = -1;
+    }
+    int& position = page[element & (pageSize - 1)];
+    if (position < 0) {
+        position = _vector.size();
+        _vector.push_back(element);
+    }
+}
+
+void PagedDiceSet::remove(int element) {
+    int index = position(element);
+    if (index < 0)
+        return;
+    int lastElement = _vector.back();
+    _vector[index] = lastElement;
+    _pages[lastElement >> pageBits][lastElement & (pageSize - 1)] = index;
+    _vector.pop_back();
+    _pages[element >> pageBits][element & (pageSize - 1)] = -1;
+}
+
+int PagedDiceSet::get(int index) {
+    return _vector[index];
+}
+
+int PagedDiceSet::position(int element) {
+    auto& page = _pages[element >> pageBits];
+    if (!page)
+        return -1;
+    return page[element & (pageSize - 1)];
+}
+
+int PagedDiceSet::size() {
+    return _vector.size();
+}
+
+void PagedDiceSet::clear() {
+    for (auto& page: _pages)
+        page.reset();
+    _vector.clear();
+}
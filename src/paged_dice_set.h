@@ -0,0 +1,26 @@
+#ifndef PAGED_DICE_SET_H_
+#define PAGED_DICE_SET_H_
+
+#include <vector>
+#include <memory>
+
+// DiceSet over [0, capacity) that keeps positions in an int array instead of
+// a hash map. The array is split into pages that are only allocated once one
+// of their elements is added, so sparse borders stay cheap on big lattices.
+class PagedDiceSet {
+    public:
+        PagedDiceSet(int capacity);
+        void add(int element);
+        void remove(int element);
+        int get(int index);
+        int position(int element);
+        int size();
+        void clear();
+    private:
+        static const int pageBits = 12;
+        static const int pageSize = 1 << pageBits;
+        std::vector<std::unique_ptr<int[]>> _pages;
+        std::vector<int> _vector;
+};
+
+#endif // PAGED_DICE_SET_H_
@@ -0,0 +1,78 @@
+/*
+philox.h - Counter-based PRNG implementing Philox4x32-10 (Salmon et al.,
+"Parallel random numbers: as easy as 1, 2, 3", SC 2011)
+
+Every output is a pure function of a 64-bit key and a 128-bit counter, so a
+stream can be opened anywhere without replaying the ones before it. Three of
+the four counter words name the stream (for example Monte Carlo step, sweep
+phase and block), the fourth is advanced as numbers are drawn.
+*/
+
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <stdint.h>
+
+struct philox4x32 {
+    uint32_t key[2];
+    uint32_t counter[4];
+    uint32_t output[4];
+    int used; //number of words of output already handed out
+};
+
+static inline void philox4x32Round(uint32_t counter[4], const uint32_t key[2]) {
+    const uint64_t product0 = (uint64_t)0xD2511F53 * counter[0];
+    const uint64_t product1 = (uint64_t)0xCD9E8D57 * counter[2];
+    const uint32_t hi0 = product0 >> 32, lo0 = (uint32_t)product0;
+    const uint32_t hi1 = product1 >> 32, lo1 = (uint32_t)product1;
+    counter[0] = hi1 ^ counter[1] ^ key[0];
+    counter[1] = lo1;
+    counter[2] = hi0 ^ counter[3] ^ key[1];
+    counter[3] = lo0;
+}
+
+static inline void philox4x32Block(const uint32_t counter[4],
+        const uint32_t key[2], uint32_t output[4]) {
+    uint32_t k[2] = {key[0], key[1]};
+    for (int i = 0; i < 4; i++)
+        output[i] = counter[i];
+    for (int round = 0; round < 10; round++) {
+        philox4x32Round(output, k);
+        k[0] += 0x9E3779B9;
+        k[1] += 0xBB67AE85;
+    }
+}
+
+//opens the stream (a, b, c) of the generator keyed on seed
+static inline void philox4x32Seed(struct philox4x32* ctx, uint64_t seed,
+        uint32_t a, uint32_t b, uint32_t c) {
+    ctx->key[0] = (uint32_t)seed;
+    ctx->key[1] = (uint32_t)(seed >> 32);
+    ctx->counter[0] = 0;
+    ctx->counter[1] = a;
+    ctx->counter[2] = b;
+    ctx->counter[3] = c;
+    ctx->used = 4;
+}
+
+static inline uint32_t philox4x32Next32(struct philox4x32* ctx) {
+    if (ctx->used == 4) {
+        philox4x32Block(ctx->counter, ctx->key, ctx->output);
+        ctx->counter[0]++;
+        ctx->used = 0;
+    }
+    return ctx->output[ctx->used++];
+}
+
+//returns a random uint64, like ranxoshi256Next
+static inline uint64_t philox4x32Next(struct philox4x32* ctx) {
+    const uint64_t hi = philox4x32Next32(ctx);
+    return (hi << 32) | philox4x32Next32(ctx);
+}
+
+//returns a random double in the range [0.0, 1.0), like ranxoshi256DoubleCO
+static inline double philox4x32DoubleCO(struct philox4x32* ctx) {
+    return (double)(philox4x32Next(ctx) >> 11)/9007199254740992.0;
+}
+
+#endif //PHILOX_H
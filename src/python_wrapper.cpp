@@ -1,5 +1,7 @@
 #include <Python.h>
 #include <numpy/arrayobject.h>
+#include <string>
+#include <utility>
 
 #include "cpm.h"
 
@@ -24,14 +26,120 @@ static PyModuleDef cpmmodule = {
 };
 
 
+// Without a seed every simulation draws its own from std::random_device.
+// get_seed() returns it, so that such a run can still be repeated.
+static bool parseSeed(PyObject* seedObject, unsigned long long* seed) {
+    if (seedObject == Py_None) {
+        *seed = randomSeed();
+        return true;
+    }
+    *seed = PyLong_AsUnsignedLongLong(seedObject);
+    return ! PyErr_Occurred();
+}
+
+// The extent is a single int for a square or cubic lattice, or one int per
+// axis in (x, y[, z]) order.
+static bool parseDimensions(PyObject* object, int axes, int* dimensions) {
+    if (PyLong_Check(object)) {
+        long dimension = PyLong_AsLong(object);
+        for (int i = 0; i < axes; i++)
+            dimensions[i] = dimension;
+    } else {
+        PyObject* sequence = PySequence_Fast(object, 
+                "dimension must be an int or a sequence of ints");
+        if (sequence == NULL)
+            return false;
+        if (PySequence_Fast_GET_SIZE(sequence) != axes) {
+            Py_DECREF(sequence);
+            PyErr_Format(PyExc_ValueError, "dimension needs %d extents", axes);
+            return false;
+        }
+        for (int i = 0; i < axes; i++)
+            dimensions[i] = PyLong_AsLong(PySequence_Fast_GET_ITEM(sequence, i));
+        Py_DECREF(sequence);
+    }
+    if (PyErr_Occurred())
+        return false;
+    for (int i = 0; i < axes; i++) {
+        if (dimensions[i] < 1) {
+            PyErr_SetString(PyExc_ValueError, "extents must be positive");
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parseBoundary(PyObject* object, Boundary* boundary) {
+    const char* name = PyUnicode_Check(object) ? 
+        PyUnicode_AsUTF8(object) : NULL;
+    if (name != NULL && strcmp(name, "periodic") == 0) {
+        *boundary = Boundary::periodic;
+    } else if (name != NULL && strcmp(name, "wall") == 0) {
+        *boundary = Boundary::wall;
+    } else {
+        PyErr_SetString(PyExc_ValueError, 
+                "boundary must be 'periodic' or 'wall'");
+        return false;
+    }
+    return true;
+}
+
+// Periodic by default; a single name applies to all axes, otherwise there
+// is one per axis in (x, y[, z]) order.
+static bool parseBoundaries(PyObject* object, int axes, 
+        std::vector<Boundary>& boundaries) {
+    boundaries.assign(axes, Boundary::periodic);
+    if (object == Py_None)
+        return true;
+    if (PyUnicode_Check(object)) {
+        Boundary boundary;
+        if (! parseBoundary(object, &boundary))
+            return false;
+        boundaries.assign(axes, boundary);
+        return true;
+    }
+    PyObject* sequence = PySequence_Fast(object, 
+            "boundary must be a string or a sequence of strings");
+    if (sequence == NULL)
+        return false;
+    bool valid = PySequence_Fast_GET_SIZE(sequence) == axes;
+    if (! valid)
+        PyErr_Format(PyExc_ValueError, "boundary needs %d entries", axes);
+    for (int i = 0; valid && i < axes; i++)
+        valid = parseBoundary(PySequence_Fast_GET_ITEM(sequence, i), 
+                &boundaries[i]);
+    Py_DECREF(sequence);
+    return valid;
+}
+
 static int PyCpm2d_init(PyCpm2d *self, PyObject* args, PyObject* kwds) {
-    int dimension;
+    char* keywords [] = {
+        "dimension",
+        "number_of_types",
+        "temperature",
+        "seed",
+        "boundary",
+        NULL
+    };
+    PyObject* dimensionObject;
     int numberOfTypes;
     int temperature;
-    if (! PyArg_ParseTuple(args, "iii", &dimension, &numberOfTypes, &temperature))
+    PyObject* seedObject = Py_None;
+    PyObject* boundaryObject = Py_None;
+    if (! PyArg_ParseTupleAndKeywords(args, kwds, "Oii|OO", keywords, 
+                &dimensionObject, &numberOfTypes, &temperature, &seedObject,
+                &boundaryObject))
+        return -1;
+    int dimensions[2];
+    std::vector<Boundary> boundaries;
+    unsigned long long seed;
+    if (! parseDimensions(dimensionObject, 2, dimensions) || 
+            ! parseBoundaries(boundaryObject, 2, boundaries) ||
+            ! parseSeed(seedObject, &seed))
         return -1;
 
-    self->ptrObj = new Cpm<Lattice2d>(dimension, numberOfTypes, temperature);
+    self->ptrObj = new Cpm<Lattice2d>({dimensions[0], dimensions[1]}, boundaries, 
+            numberOfTypes, temperature, seed);
     return 0;
 }
 
@@ -48,13 +156,33 @@ static PyTypeObject PyCpm2dType = { PyVarObject_HEAD_INIT(NULL, 0)
 
 
 static int PyCpm3d_init(PyCpm3d *self, PyObject* args, PyObject* kwds) {
-    int dimension;
+    char* keywords [] = {
+        "dimension",
+        "number_of_types",
+        "temperature",
+        "seed",
+        "boundary",
+        NULL
+    };
+    PyObject* dimensionObject;
     int numberOfTypes;
     int temperature;
-    if (! PyArg_ParseTuple(args, "iii", &dimension, &numberOfTypes, &temperature))
+    PyObject* seedObject = Py_None;
+    PyObject* boundaryObject = Py_None;
+    if (! PyArg_ParseTupleAndKeywords(args, kwds, "Oii|OO", keywords, 
+                &dimensionObject, &numberOfTypes, &temperature, &seedObject,
+                &boundaryObject))
+        return -1;
+    int dimensions[3];
+    std::vector<Boundary> boundaries;
+    unsigned long long seed;
+    if (! parseDimensions(dimensionObject, 3, dimensions) || 
+            ! parseBoundaries(boundaryObject, 3, boundaries) ||
+            ! parseSeed(seedObject, &seed))
         return -1;
 
-    self->ptrObj = new Cpm<Lattice3d>(dimension, numberOfTypes, temperature);
+    self->ptrObj = new Cpm<Lattice3d>({dimensions[0], dimensions[1], dimensions[2]}, boundaries, 
+            numberOfTypes, temperature, seed);
     return 0;
 }
 
@@ -69,6 +197,38 @@ static PyTypeObject PyCpm3dType = { PyVarObject_HEAD_INIT(NULL, 0)
                                     "cpm.Cpm3d"   /* tp_name */
                                 };
 
+// Takes the keywords of registered energy terms out of kwargs, so the rest
+// can be parsed as usual. Returns a new reference to the remaining
+// keywords, or NULL with an exception set.
+template <typename C>
+static PyObject* takeTermParameters(C* cpm, PyObject* kwargs,
+        std::vector<std::pair<std::string, double>>& parameters)
+{
+    if (kwargs == NULL)
+        return PyDict_New();
+    PyObject* rest = PyDict_Copy(kwargs);
+    if (rest == NULL)
+        return NULL;
+    PyObject* key;
+    PyObject* value;
+    Py_ssize_t position = 0;
+    while (PyDict_Next(kwargs, &position, &key, &value)) {
+        if (!PyUnicode_Check(key))
+            continue;
+        const char* name = PyUnicode_AsUTF8(key);
+        if (name == NULL || !cpm->hasTermParameter(name))
+            continue;
+        double number = PyFloat_AsDouble(value);
+        if (number == -1.0 && PyErr_Occurred()) {
+            Py_DECREF(rest);
+            return NULL;
+        }
+        parameters.push_back({name, number});
+        PyDict_DelItem(rest, key);
+    }
+    return rest;
+}
+
 static PyObject * PyCpm2d_setConstraints(PyCpm2d* self, PyObject* args, 
         PyObject* kwargs )
 {
@@ -88,20 +248,37 @@ static PyObject * PyCpm2d_setConstraints(PyCpm2d* self, PyObject* args,
         "persistence_time",
         "fixed",
         "lambda_chemotaxis",
+        "secretion",
+        "uptake",
         NULL
     };
     int cellType = -1, targetPerimeter = -1, 
         targetArea = -1, maxAct = -1, 
         otherCellType = -1, adhesion = -1, persistenceTime = -1, fixed = -1;
     double lambdaPerimeter = -1, lambdaArea = -1, lambdaAct = -1, connectedLambda = -1, 
-           persistenceLambda = -1, persistenceDiffusion = -1, lambdaChemotaxis=-1;
-     if (! PyArg_ParseTupleAndKeywords(args, kwargs, "i|$idididiidddiid", 
+           persistenceLambda = -1, persistenceDiffusion = -1, lambdaChemotaxis=-1,
+           secretion = -1, uptake = -1;
+     std::vector<std::pair<std::string, double>> termParameters;
+     PyObject* rest = takeTermParameters(self->ptrObj, kwargs, 
+             termParameters);
+     if (rest == NULL)
+         return NULL;
+     bool parsed = PyArg_ParseTupleAndKeywords(args, rest, 
+                 "i|$idididiidddiiddd", 
                  keywords, &cellType, &otherCellType, &lambdaPerimeter, 
                  &targetPerimeter, &lambdaArea, &targetArea, &lambdaAct, 
                  &maxAct, &adhesion, &connectedLambda, &persistenceLambda, 
-                 &persistenceDiffusion, &persistenceTime, &fixed, &lambdaChemotaxis))
+                 &persistenceDiffusion, &persistenceTime, &fixed, &lambdaChemotaxis,
+                 &secretion, &uptake);
+     Py_DECREF(rest);
+     if (! parsed)
          return Py_False;
 
+     for (auto& parameter: termParameters) {
+         (self->ptrObj)->setTermParameter(cellType, parameter.first.c_str(),
+                 parameter.second);
+     }
+
      if (fixed >= 0) {
          (self->ptrObj)->setFixedConstraint(cellType, fixed);
      }
@@ -127,6 +304,14 @@ static PyObject * PyCpm2d_setConstraints(PyCpm2d* self, PyObject* args,
          (self->ptrObj)->setChemotaxisConstraints(cellType, lambdaChemotaxis);
      }
 
+     if (secretion >= 0) {
+         (self->ptrObj)->setSecretion(cellType, secretion);
+     }
+
+     if (uptake >= 0) {
+         (self->ptrObj)->setUptake(cellType, uptake);
+     }
+
      if (persistenceLambda >= 0 && persistenceDiffusion >= 0 && persistenceTime >= 0) {
          (self->ptrObj)->setPersistenceConstraints(cellType, persistenceLambda, 
                  persistenceTime, persistenceDiffusion);
@@ -161,20 +346,38 @@ static PyObject * PyCpm3d_setConstraints(PyCpm3d* self, PyObject* args,
         "persistence_diffusion",
         "persistence_time",
         "fixed",
+        "lambda_chemotaxis",
+        "secretion",
+        "uptake",
         NULL
     };
     int cellType = -1, targetPerimeter = -1, 
         targetArea = -1, maxAct = -1, 
         otherCellType = -1, adhesion = -1, persistenceTime = -1, fixed = -1;
     double lambdaPerimeter = -1, lambdaArea = -1, lambdaAct = -1, connectedLambda = -1, 
-           persistenceLambda = -1, persistenceDiffusion = -1;
-     if (! PyArg_ParseTupleAndKeywords(args, kwargs, "i|$idididiidddii", 
+           persistenceLambda = -1, persistenceDiffusion = -1, lambdaChemotaxis=-1,
+           secretion = -1, uptake = -1;
+     std::vector<std::pair<std::string, double>> termParameters;
+     PyObject* rest = takeTermParameters(self->ptrObj, kwargs, 
+             termParameters);
+     if (rest == NULL)
+         return NULL;
+     bool parsed = PyArg_ParseTupleAndKeywords(args, rest, 
+                 "i|$idididiidddiiddd", 
                  keywords, &cellType, &otherCellType, &lambdaPerimeter, 
                  &targetPerimeter, &lambdaArea, &targetArea, &lambdaAct, 
                  &maxAct, &adhesion, &connectedLambda, &persistenceLambda, 
-                 &persistenceDiffusion, &persistenceTime, &fixed))
+                 &persistenceDiffusion, &persistenceTime, &fixed, &lambdaChemotaxis,
+                 &secretion, &uptake);
+     Py_DECREF(rest);
+     if (! parsed)
          return Py_False;
 
+     for (auto& parameter: termParameters) {
+         (self->ptrObj)->setTermParameter(cellType, parameter.first.c_str(),
+                 parameter.second);
+     }
+
      if (fixed >= 0) {
          (self->ptrObj)->setFixedConstraint(cellType, fixed);
      }
@@ -196,6 +399,18 @@ static PyObject * PyCpm3d_setConstraints(PyCpm3d* self, PyObject* args,
          (self->ptrObj)->setConnectedConstraints(cellType, connectedLambda);
      }
 
+     if (lambdaChemotaxis >= 0) {
+         (self->ptrObj)->setChemotaxisConstraints(cellType, lambdaChemotaxis);
+     }
+
+     if (secretion >= 0) {
+         (self->ptrObj)->setSecretion(cellType, secretion);
+     }
+
+     if (uptake >= 0) {
+         (self->ptrObj)->setUptake(cellType, uptake);
+     }
+
      if (persistenceLambda >= 0 && persistenceDiffusion >= 0 && persistenceTime >= 0) {
          (self->ptrObj)->setPersistenceConstraints(cellType, persistenceLambda, 
                  persistenceTime, persistenceDiffusion);
@@ -282,7 +497,7 @@ static PyObject * PyCpm2d_updateType(PyCpm2d* self, PyObject* args)
     return Py_None;
 }
 
-static PyObject * PyCpm3d_updateType(PyCpm2d* self, PyObject* args)
+static PyObject * PyCpm3d_updateType(PyCpm3d* self, PyObject* args)
 {
     int id, type;
 
@@ -294,53 +509,318 @@ static PyObject * PyCpm3d_updateType(PyCpm2d* self, PyObject* args)
     return Py_None;
 }
 
+static PyObject * PyCpm2d_killCell(PyCpm2d* self, PyObject* args, 
+        PyObject* kwargs)
+{
+    char* keywords [] = {
+        "cell_id",
+        "recycle",
+        NULL
+    };
+    int id;
+    int recycle = 0;
+
+    if (! PyArg_ParseTupleAndKeywords(args, kwargs, "i|p", keywords, &id,
+                &recycle))
+        return NULL;
+    (self->ptrObj)->killCell(id, recycle);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
 
-static PyObject * PyCpm2d_run(PyCpm2d* self, PyObject* args)
+static PyObject * PyCpm3d_killCell(PyCpm3d* self, PyObject* args, 
+        PyObject* kwargs)
 {
+    char* keywords [] = {
+        "cell_id",
+        "recycle",
+        NULL
+    };
+    int id;
+    int recycle = 0;
+
+    if (! PyArg_ParseTupleAndKeywords(args, kwargs, "i|p", keywords, &id,
+                &recycle))
+        return NULL;
+    (self->ptrObj)->killCell(id, recycle);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static bool parseDivisionAxis(const char* name, DivisionAxis* axis)
+{
+    if (strcmp(name, "major") == 0) {
+        *axis = DivisionAxis::major;
+    } else if (strcmp(name, "minor") == 0) {
+        *axis = DivisionAxis::minor;
+    } else if (strcmp(name, "random") == 0) {
+        *axis = DivisionAxis::random;
+    } else {
+        PyErr_Format(PyExc_ValueError, "unknown division axis '%s'", name);
+        return false;
+    }
+    return true;
+}
+
+static PyObject * idsToArray(const std::vector<int>& ids)
+{
+    npy_intp shape[] = {(npy_intp)ids.size()};
+    PyObject* arr = PyArray_SimpleNew(1, shape, NPY_INT);
+    if (arr == NULL)
+        return NULL;
+    std::copy(ids.begin(), ids.end(), (int*)PyArray_DATA((PyArrayObject*)arr));
+    return arr;
+}
+
+static bool parseIds(PyObject* object, std::vector<int>& ids)
+{
+    PyArrayObject* arr = (PyArrayObject*)PyArray_FROMANY(object, NPY_INT,
+            1, 1, NPY_ARRAY_IN_ARRAY | NPY_ARRAY_FORCECAST);
+    if (arr == NULL)
+        return false;
+    int* data = (int*)PyArray_DATA(arr);
+    ids.assign(data, data + PyArray_DIMS(arr)[0]);
+    Py_DECREF(arr);
+    return true;
+}
+
+static PyObject * PyCpm2d_divideCell(PyCpm2d* self, PyObject* args, 
+        PyObject* kwargs)
+{
+    char* keywords [] = {
+        "cell_id",
+        "axis",
+        NULL
+    };
+    int id;
+    const char* axisName = "major";
+
+    if (! PyArg_ParseTupleAndKeywords(args, kwargs, "i|s", keywords, &id,
+                &axisName))
+        return NULL;
+    DivisionAxis axis;
+    if (! parseDivisionAxis(axisName, &axis))
+        return NULL;
+    return PyLong_FromLong((self->ptrObj)->divideCell(id, axis));
+}
+
+static PyObject * PyCpm3d_divideCell(PyCpm3d* self, PyObject* args, 
+        PyObject* kwargs)
+{
+    char* keywords [] = {
+        "cell_id",
+        "axis",
+        NULL
+    };
+    int id;
+    const char* axisName = "major";
+
+    if (! PyArg_ParseTupleAndKeywords(args, kwargs, "i|s", keywords, &id,
+                &axisName))
+        return NULL;
+    DivisionAxis axis;
+    if (! parseDivisionAxis(axisName, &axis))
+        return NULL;
+    return PyLong_FromLong((self->ptrObj)->divideCell(id, axis));
+}
+
+static PyObject * PyCpm2d_divideCells(PyCpm2d* self, PyObject* args, 
+        PyObject* kwargs)
+{
+    char* keywords [] = {
+        "cell_ids",
+        "axis",
+        "threads",
+        NULL
+    };
+    PyObject* idsObject;
+    const char* axisName = "major";
+    int threads = 1;
+    std::vector<int> ids;
+
+    if (! PyArg_ParseTupleAndKeywords(args, kwargs, "O|si", keywords, 
+                &idsObject, &axisName, &threads))
+        return NULL;
+    DivisionAxis axis;
+    if (! parseDivisionAxis(axisName, &axis) || ! parseIds(idsObject, ids))
+        return NULL;
+    return idsToArray((self->ptrObj)->divideCells(ids, axis, threads));
+}
+
+static PyObject * PyCpm3d_divideCells(PyCpm3d* self, PyObject* args, 
+        PyObject* kwargs)
+{
+    char* keywords [] = {
+        "cell_ids",
+        "axis",
+        "threads",
+        NULL
+    };
+    PyObject* idsObject;
+    const char* axisName = "major";
+    int threads = 1;
+    std::vector<int> ids;
+
+    if (! PyArg_ParseTupleAndKeywords(args, kwargs, "O|si", keywords, 
+                &idsObject, &axisName, &threads))
+        return NULL;
+    DivisionAxis axis;
+    if (! parseDivisionAxis(axisName, &axis) || ! parseIds(idsObject, ids))
+        return NULL;
+    return idsToArray((self->ptrObj)->divideCells(ids, axis, threads));
+}
+
+static bool parseEngine(const char* name, Engine* engine)
+{
+    if (name == NULL) {
+        *engine = Engine::automatic;
+    } else if (strcmp(name, "serial") == 0) {
+        *engine = Engine::serial;
+    } else if (strcmp(name, "checkerboard") == 0) {
+        *engine = Engine::checkerboard;
+    } else if (strcmp(name, "speculative") == 0) {
+        *engine = Engine::speculative;
+    } else if (strcmp(name, "rejection_free") == 0) {
+        *engine = Engine::rejectionFree;
+    } else {
+        PyErr_Format(PyExc_ValueError, "unknown engine '%s'", name);
+        return false;
+    }
+    return true;
+}
+
+static PyObject * engineStatsToDict(EngineStats stats)
+{
+    double evaluations = stats.accepted + stats.conflicts;
+    return Py_BuildValue("{s:L,s:L,s:L,s:d,s:d}",
+            "attempts", stats.attempts,
+            "accepted", stats.accepted,
+            "conflicts", stats.conflicts,
+            "conflict_rate", evaluations > 0 ? stats.conflicts / evaluations : 0.0,
+            "retry_rate", stats.attempts > 0 ? 
+                stats.conflicts / (double)stats.attempts : 0.0);
+}
+
+static PyObject * PyCpm2d_getSeed(PyCpm2d* self, PyObject* args)
+{
+    return PyLong_FromUnsignedLongLong((self->ptrObj)->getSeed());
+}
+
+static PyObject * PyCpm3d_getSeed(PyCpm3d* self, PyObject* args)
+{
+    return PyLong_FromUnsignedLongLong((self->ptrObj)->getSeed());
+}
+
+static PyObject * PyCpm2d_getEngineStats(PyCpm2d* self, PyObject* args)
+{
+    return engineStatsToDict((self->ptrObj)->getEngineStats());
+}
+
+static PyObject * PyCpm3d_getEngineStats(PyCpm3d* self, PyObject* args)
+{
+    return engineStatsToDict((self->ptrObj)->getEngineStats());
+}
+
+static PyObject * PyCpm2d_run(PyCpm2d* self, PyObject* args, 
+        PyObject* kwargs)
+{
+    char* keywords [] = {
+        "ticks",
+        "threads",
+        "engine",
+        NULL
+    };
     int ticks;
+    int threads = 1;
+    char* engineName = NULL;
 
-    if (! PyArg_ParseTuple(args, "i", &ticks))
+    if (! PyArg_ParseTupleAndKeywords(args, kwargs, "i|iz", keywords, &ticks,
+                &threads, &engineName))
         return Py_False;
-    (self->ptrObj)->run(ticks);
+    Engine engine;
+    if (! parseEngine(engineName, &engine))
+        return NULL;
+    (self->ptrObj)->run(ticks, threads, engine);
 
     Py_INCREF(Py_None);
     return Py_None;
 }
 
-static PyObject * PyCpm3d_run(PyCpm3d* self, PyObject* args)
+static PyObject * PyCpm3d_run(PyCpm3d* self, PyObject* args, 
+        PyObject* kwargs)
 {
+    char* keywords [] = {
+        "ticks",
+        "threads",
+        "engine",
+        NULL
+    };
     int ticks;
+    int threads = 1;
+    char* engineName = NULL;
 
-    if (! PyArg_ParseTuple(args, "i", &ticks))
+    if (! PyArg_ParseTupleAndKeywords(args, kwargs, "i|iz", keywords, &ticks,
+                &threads, &engineName))
         return Py_False;
+    Engine engine;
+    if (! parseEngine(engineName, &engine))
+        return NULL;
 
-    (self->ptrObj)->run(ticks);
+    (self->ptrObj)->run(ticks, threads, engine);
 
     Py_INCREF(Py_None);
     return Py_None;
 }
 
-static PyObject * PyCpm2d_runAsync(PyCpm2d* self, PyObject* args)
+static PyObject * PyCpm2d_runAsync(PyCpm2d* self, PyObject* args, 
+        PyObject* kwargs)
 {
+    char* keywords [] = {
+        "ticks",
+        "threads",
+        "engine",
+        NULL
+    };
     int ticks;
+    int threads = 1;
+    char* engineName = NULL;
 
-    if (! PyArg_ParseTuple(args, "i", &ticks))
+    if (! PyArg_ParseTupleAndKeywords(args, kwargs, "i|iz", keywords, &ticks,
+                &threads, &engineName))
         return Py_False;
+    Engine engine;
+    if (! parseEngine(engineName, &engine))
+        return NULL;
 
-    (self->ptrObj)->runAsync(ticks);
+    (self->ptrObj)->runAsync(ticks, threads, engine);
 
     Py_INCREF(Py_None);
     return Py_None;
 }
 
-static PyObject * PyCpm3d_runAsync(PyCpm3d* self, PyObject* args)
+static PyObject * PyCpm3d_runAsync(PyCpm3d* self, PyObject* args, 
+        PyObject* kwargs)
 {
+    char* keywords [] = {
+        "ticks",
+        "threads",
+        "engine",
+        NULL
+    };
     int ticks;
+    int threads = 1;
+    char* engineName = NULL;
 
-    if (! PyArg_ParseTuple(args, "i", &ticks))
+    if (! PyArg_ParseTupleAndKeywords(args, kwargs, "i|iz", keywords, &ticks,
+                &threads, &engineName))
         return Py_False;
+    Engine engine;
+    if (! parseEngine(engineName, &engine))
+        return NULL;
 
-    (self->ptrObj)->runAsync(ticks);
+    (self->ptrObj)->runAsync(ticks, threads, engine);
 
     Py_INCREF(Py_None);
     return Py_None;
@@ -362,60 +842,473 @@ static PyObject * PyCpm3d_join(PyCpm3d* self, PyObject* args)
     return Py_None;
 }
 
-static PyObject * PyCpm2d_getField(PyCpm2d* self, PyObject* args)
+static bool parseFieldStorage(const char* name, FieldStorage* storage)
+{
+    if (strcmp(name, "float64") == 0) {
+        *storage = FieldStorage::float64;
+    } else if (strcmp(name, "float32") == 0) {
+        *storage = FieldStorage::float32;
+    } else if (strcmp(name, "float16") == 0) {
+        *storage = FieldStorage::float16;
+    } else if (strcmp(name, "coarse") == 0) {
+        *storage = FieldStorage::coarse;
+    } else if (strcmp(name, "analytic") == 0) {
+        *storage = FieldStorage::analytic;
+    } else {
+        PyErr_Format(PyExc_ValueError, "unknown field storage '%s'", name);
+        return false;
+    }
+    return true;
+}
+
+static bool parseVector(PyObject* object, int axes, double* vector)
 {
-    int dimension = (self->ptrObj)->getDimension();
-    npy_intp shape[] = {2,dimension, dimension};
-    PyObject*  arr = PyArray_SimpleNewFromData(3, shape, NPY_DOUBLE, 
-            (self->ptrObj)->getField());
+    PyObject* sequence = PySequence_Fast(object, "expected a sequence");
+    if (sequence == NULL)
+        return false;
+    bool valid = PySequence_Fast_GET_SIZE(sequence) == axes;
+    if (! valid)
+        PyErr_Format(PyExc_ValueError, "expected %d coordinates", axes);
+    for (int i = 0; valid && i < axes; i++) {
+        vector[i] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(sequence, i));
+        valid = ! PyErr_Occurred();
+    }
+    Py_DECREF(sequence);
+    return valid;
+}
+
+// A copy, as the table grows when cells are added, so that
+// get_cell_types()[get_state()] gives the type of every voxel.
+static PyObject * cellTypesToArray(const std::vector<char>& types)
+{
+    npy_intp shape[] = {(npy_intp)types.size()};
+    PyObject* arr = PyArray_SimpleNew(1, shape, NPY_INT);
+    if (arr == NULL)
+        return NULL;
+    int* data = (int*)PyArray_DATA((PyArrayObject*)arr);
+    for (size_t i = 0; i < types.size(); i++)
+        data[i] = types[i];
     return arr;
 }
 
+// Per voxel storages are shared with the simulation; coarse and analytic
+// fields are materialised into a new array.
+static PyObject * fieldToArray(GradientField& field, int nd, npy_intp* shape)
+{
+    switch (field.getStorage()) {
+        case FieldStorage::float64:
+            return PyArray_SimpleNewFromData(nd, shape, NPY_DOUBLE, 
+                    field.data());
+        case FieldStorage::float32:
+            return PyArray_SimpleNewFromData(nd, shape, NPY_FLOAT, 
+                    field.data());
+        case FieldStorage::float16:
+            return PyArray_SimpleNewFromData(nd, shape, NPY_HALF, 
+                    field.data());
+        default:
+            PyObject* arr = PyArray_SimpleNew(nd, shape, NPY_DOUBLE);
+            if (arr != NULL)
+                field.materialize((double*)PyArray_DATA((PyArrayObject*)arr));
+            return arr;
+    }
+}
+
+static PyObject * fieldFromArray(GradientField& field, PyObject* arg, 
+        int nd, npy_intp* shape)
+{
+    if (field.getStorage() == FieldStorage::analytic) {
+        PyErr_SetString(PyExc_ValueError, 
+                "an analytic field is set through its sources");
+        return NULL;
+    }
+    PyArrayObject* arr = (PyArrayObject*)PyArray_FROMANY(arg, NPY_DOUBLE, 
+            nd, nd, NPY_ARRAY_IN_ARRAY);
+    if (arr == NULL)
+        return NULL;
+    bool valid = true;
+    for (int i = 0; i < nd; i++)
+        valid = valid && PyArray_DIMS(arr)[i] == shape[i];
+    if (valid)
+        field.assign((const double*)PyArray_DATA(arr));
+    else
+        PyErr_SetString(PyExc_ValueError, 
+                "array shape must match the field, as get_field returns it");
+    Py_DECREF(arr);
+    if (! valid)
+        return NULL;
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject * setFieldStorage(GradientField& field, PyObject* args, 
+        PyObject* kwargs)
+{
+    char* keywords [] = {
+        "storage",
+        "coarsening",
+        NULL
+    };
+    char* name;
+    int coarsening = 4;
+    if (! PyArg_ParseTupleAndKeywords(args, kwargs, "s|i", keywords, &name,
+                &coarsening))
+        return NULL;
+    FieldStorage storage;
+    if (! parseFieldStorage(name, &storage))
+        return NULL;
+    field.setStorage(storage, coarsening);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// A point source, or a line source when a direction is given.
+static PyObject * addFieldSource(GradientField& field, PyObject* args, 
+        PyObject* kwargs)
+{
+    char* keywords [] = {
+        "position",
+        "strength",
+        "decay_length",
+        "direction",
+        NULL
+    };
+    PyObject* positionArg;
+    PyObject* directionArg = Py_None;
+    double strength = 1.0;
+    double decayLength = 10.0;
+    if (! PyArg_ParseTupleAndKeywords(args, kwargs, "O|ddO", keywords, 
+                &positionArg, &strength, &decayLength, &directionArg))
+        return NULL;
+    if (field.getStorage() != FieldStorage::analytic) {
+        PyErr_SetString(PyExc_ValueError, 
+                "sources need field storage 'analytic'");
+        return NULL;
+    }
+    if (decayLength <= 0) {
+        PyErr_SetString(PyExc_ValueError, "decay_length must be positive");
+        return NULL;
+    }
+    double position[3];
+    double direction[3];
+    if (! parseVector(positionArg, field.components(), position))
+        return NULL;
+    if (directionArg != Py_None && 
+            ! parseVector(directionArg, field.components(), direction))
+        return NULL;
+    field.addSource(position, directionArg != Py_None ? direction : NULL, 
+            strength, decayLength);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+struct ChemokineSettings {
+    double diffusion;
+    double decay;
+    double timestep;
+    int interval;
+    int coarsening;
+    ChemokineSolver solver;
+};
+
+static bool parseChemokine(PyObject* args, PyObject* kwargs, 
+        ChemokineSettings* settings)
+{
+    char* keywords [] = {
+        "diffusion",
+        "decay",
+        "timestep",
+        "interval",
+        "solver",
+        "coarsening",
+        NULL
+    };
+    settings->decay = 0.0;
+    settings->timestep = 1.0;
+    settings->interval = 1;
+    settings->coarsening = 1;
+    char* solverName = NULL;
+    if (! PyArg_ParseTupleAndKeywords(args, kwargs, "d|ddizi", keywords, 
+                &settings->diffusion, &settings->decay, &settings->timestep, 
+                &settings->interval, &solverName, &settings->coarsening))
+        return false;
+    if (solverName == NULL || strcmp(solverName, "implicit") == 0) {
+        settings->solver = ChemokineSolver::implicitSplit;
+    } else if (strcmp(solverName, "explicit") == 0) {
+        settings->solver = ChemokineSolver::explicitEuler;
+    } else if (strcmp(solverName, "steady") == 0) {
+        settings->solver = ChemokineSolver::steadyState;
+    } else {
+        PyErr_Format(PyExc_ValueError, "unknown solver '%s'", solverName);
+        return false;
+    }
+    if (settings->diffusion < 0 || settings->decay < 0 || 
+            settings->timestep <= 0 || settings->interval < 1 || 
+            settings->coarsening < 1) {
+        PyErr_SetString(PyExc_ValueError, "diffusion and decay must not be "
+                "negative, timestep, interval and coarsening must be "
+                "positive");
+        return false;
+    }
+    return true;
+}
+
+static PyObject * PyCpm2d_setChemokine(PyCpm2d* self, PyObject* args, 
+        PyObject* kwargs)
+{
+    ChemokineSettings settings;
+    if (! parseChemokine(args, kwargs, &settings))
+        return NULL;
+    if (! (self->ptrObj)->setChemokine(settings.diffusion, settings.decay, 
+                settings.timestep, settings.interval, settings.coarsening, 
+                settings.solver)) {
+        PyErr_SetString(PyExc_ValueError, 
+                "coarsening must divide every periodic axis");
+        return NULL;
+    }
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject * PyCpm3d_setChemokine(PyCpm3d* self, PyObject* args, 
+        PyObject* kwargs)
+{
+    ChemokineSettings settings;
+    if (! parseChemokine(args, kwargs, &settings))
+        return NULL;
+    if (! (self->ptrObj)->setChemokine(settings.diffusion, settings.decay, 
+                settings.timestep, settings.interval, settings.coarsening, 
+                settings.solver)) {
+        PyErr_SetString(PyExc_ValueError, 
+                "coarsening must divide every periodic axis");
+        return NULL;
+    }
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static bool parseAcceptance(PyObject* args, PyObject* kwargs,
+        Acceptance* acceptance, int* tableSize)
+{
+    char* keywords [] = {
+        "mode",
+        "table_size",
+        NULL
+    };
+    char* name = NULL;
+    *tableSize = 256;
+    if (! PyArg_ParseTupleAndKeywords(args, kwargs, "|zi", keywords, &name,
+                tableSize))
+        return false;
+    if (name == NULL || strcmp(name, "exact") == 0) {
+        *acceptance = Acceptance::exact;
+    } else if (strcmp(name, "threshold") == 0) {
+        *acceptance = Acceptance::threshold;
+    } else {
+        PyErr_Format(PyExc_ValueError, "unknown acceptance '%s'", name);
+        return false;
+    }
+    if (*tableSize < 0) {
+        PyErr_SetString(PyExc_ValueError, "table_size must not be negative");
+        return false;
+    }
+    return true;
+}
+
+static PyObject * PyCpm2d_setAcceptance(PyCpm2d* self, PyObject* args, 
+        PyObject* kwargs)
+{
+    Acceptance acceptance;
+    int tableSize;
+    if (! parseAcceptance(args, kwargs, &acceptance, &tableSize))
+        return NULL;
+    (self->ptrObj)->setAcceptance(acceptance, tableSize);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject * PyCpm3d_setAcceptance(PyCpm3d* self, PyObject* args, 
+        PyObject* kwargs)
+{
+    Acceptance acceptance;
+    int tableSize;
+    if (! parseAcceptance(args, kwargs, &acceptance, &tableSize))
+        return NULL;
+    (self->ptrObj)->setAcceptance(acceptance, tableSize);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject * PyCpm2d_setAdhesionCache(PyCpm2d* self, PyObject* args)
+{
+    int enabled;
+    if (! PyArg_ParseTuple(args, "p", &enabled))
+        return NULL;
+    (self->ptrObj)->setAdhesionCache(enabled);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject * PyCpm2d_getConcentration(PyCpm2d* self, PyObject* args)
+{
+    auto& chemokine = (self->ptrObj)->getChemokine();
+    npy_intp shape[] = {chemokine.dimension(1), chemokine.dimension(0)};
+    return PyArray_SimpleNewFromData(2, shape, NPY_DOUBLE, 
+            chemokine.getConcentration());
+}
+
+static PyObject * PyCpm3d_setAdhesionCache(PyCpm3d* self, PyObject* args)
+{
+    int enabled;
+    if (! PyArg_ParseTuple(args, "p", &enabled))
+        return NULL;
+    (self->ptrObj)->setAdhesionCache(enabled);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject * PyCpm3d_getConcentration(PyCpm3d* self, PyObject* args)
+{
+    auto& chemokine = (self->ptrObj)->getChemokine();
+    npy_intp shape[] = {chemokine.dimension(2), chemokine.dimension(1), 
+        chemokine.dimension(0)};
+    return PyArray_SimpleNewFromData(3, shape, NPY_DOUBLE, 
+            chemokine.getConcentration());
+}
+
+static PyObject * PyCpm2d_getField(PyCpm2d* self, PyObject* args)
+{
+    auto dimensions = (self->ptrObj)->getDimensions();
+    npy_intp shape[] = {2, dimensions.y, dimensions.x};
+    return fieldToArray((self->ptrObj)->getField(), 3, shape);
+}
+
 
 static PyObject * PyCpm3d_getField(PyCpm3d* self, PyObject* args)
 {
-    int dimension = (self->ptrObj)->getDimension();
-    npy_intp shape[] = {3,dimension, dimension, dimension};
-    PyObject*  arr = PyArray_SimpleNewFromData(4, shape, NPY_DOUBLE, 
-            (self->ptrObj)->getField());
-    return arr;
+    auto dimensions = (self->ptrObj)->getDimensions();
+    npy_intp shape[] = {3, dimensions.z, dimensions.y, dimensions.x};
+    return fieldToArray((self->ptrObj)->getField(), 4, shape);
+}
+
+static PyObject * PyCpm2d_setField(PyCpm2d* self, PyObject* args)
+{
+    PyObject* arg;
+    if (! PyArg_ParseTuple(args, "O", &arg))
+        return NULL;
+    auto dimensions = (self->ptrObj)->getDimensions();
+    npy_intp shape[] = {2, dimensions.y, dimensions.x};
+    return fieldFromArray((self->ptrObj)->getField(), arg, 3, shape);
+}
+
+static PyObject * PyCpm3d_setField(PyCpm3d* self, PyObject* args)
+{
+    PyObject* arg;
+    if (! PyArg_ParseTuple(args, "O", &arg))
+        return NULL;
+    auto dimensions = (self->ptrObj)->getDimensions();
+    npy_intp shape[] = {3, dimensions.z, dimensions.y, dimensions.x};
+    return fieldFromArray((self->ptrObj)->getField(), arg, 4, shape);
+}
+
+static PyObject * PyCpm2d_setFieldStorage(PyCpm2d* self, PyObject* args, 
+        PyObject* kwargs)
+{
+    return setFieldStorage((self->ptrObj)->getField(), args, kwargs);
+}
+
+static PyObject * PyCpm3d_setFieldStorage(PyCpm3d* self, PyObject* args, 
+        PyObject* kwargs)
+{
+    return setFieldStorage((self->ptrObj)->getField(), args, kwargs);
+}
+
+static PyObject * PyCpm2d_addFieldSource(PyCpm2d* self, PyObject* args, 
+        PyObject* kwargs)
+{
+    return addFieldSource((self->ptrObj)->getField(), args, kwargs);
+}
+
+static PyObject * PyCpm3d_addFieldSource(PyCpm3d* self, PyObject* args, 
+        PyObject* kwargs)
+{
+    return addFieldSource((self->ptrObj)->getField(), args, kwargs);
+}
+
+static PyObject * PyCpm2d_clearFieldSources(PyCpm2d* self, PyObject* args)
+{
+    (self->ptrObj)->getField().clearSources();
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject * PyCpm3d_clearFieldSources(PyCpm3d* self, PyObject* args)
+{
+    (self->ptrObj)->getField().clearSources();
+    Py_INCREF(Py_None);
+    return Py_None;
 }
 
 static PyObject * PyCpm2d_getState(PyCpm2d* self, PyObject* args)
 {
-    int dimension = (self->ptrObj)->getDimension();
-    npy_intp shape[] = {dimension, dimension};
-    PyObject*  arr = PyArray_SimpleNewFromData(2, shape, NPY_INT, 
-            (self->ptrObj)->getData());
+    auto dimensions = (self->ptrObj)->getDimensions();
+    npy_intp shape[] = {dimensions.y, dimensions.x};
+    npy_intp strides[2];
+    for (int i = 0; i < 2; i++)
+        strides[i] = (self->ptrObj)->getStride(1 - i) * sizeof(int);
+    PyObject*  arr = PyArray_New(&PyArray_Type, 2, shape, NPY_INT, strides,
+            (self->ptrObj)->getData(), 0, NPY_ARRAY_ALIGNED | NPY_ARRAY_WRITEABLE,
+            NULL);
     return arr;
 }
 
 
 static PyObject * PyCpm3d_getState(PyCpm3d* self, PyObject* args)
 {
-    int dimension = (self->ptrObj)->getDimension();
-    npy_intp shape[] = {dimension, dimension, dimension};
-    PyObject*  arr = PyArray_SimpleNewFromData(3, shape, NPY_INT, 
-            (self->ptrObj)->getData());
+    auto dimensions = (self->ptrObj)->getDimensions();
+    npy_intp shape[] = {dimensions.z, dimensions.y, dimensions.x};
+    npy_intp strides[3];
+    for (int i = 0; i < 3; i++)
+        strides[i] = (self->ptrObj)->getStride(2 - i) * sizeof(int);
+    PyObject*  arr = PyArray_New(&PyArray_Type, 3, shape, NPY_INT, strides,
+            (self->ptrObj)->getData(), 0, NPY_ARRAY_ALIGNED | NPY_ARRAY_WRITEABLE,
+            NULL);
     return arr;
 }
 
 
+static PyObject * PyCpm2d_getCellTypes(PyCpm2d* self, PyObject* args)
+{
+    return cellTypesToArray((self->ptrObj)->getCellTypes());
+}
+
 static PyObject * PyCpm2d_getActState(PyCpm2d* self, PyObject* args)
 {
-    int dimension = (self->ptrObj)->getDimension();
-    npy_intp shape[] = {dimension, dimension};
-    PyObject*  arr = PyArray_SimpleNewFromData(2, shape, NPY_INT, 
-            (self->ptrObj)->getActData());
+    auto dimensions = (self->ptrObj)->getDimensions();
+    npy_intp shape[] = {dimensions.y, dimensions.x};
+    npy_intp strides[2];
+    for (int i = 0; i < 2; i++)
+        strides[i] = (self->ptrObj)->getStride(1 - i) * sizeof(int);
+    PyObject*  arr = PyArray_New(&PyArray_Type, 2, shape, NPY_INT, strides,
+            (self->ptrObj)->getActData(), 0, NPY_ARRAY_ALIGNED | NPY_ARRAY_WRITEABLE,
+            NULL);
     return arr;
 }
 
+static PyObject * PyCpm3d_getCellTypes(PyCpm3d* self, PyObject* args)
+{
+    return cellTypesToArray((self->ptrObj)->getCellTypes());
+}
+
 static PyObject * PyCpm3d_getActState(PyCpm3d* self, PyObject* args)
 {
-    int dimension = (self->ptrObj)->getDimension();
-    npy_intp shape[] = {dimension, dimension, dimension};
-    PyObject*  arr = PyArray_SimpleNewFromData(3, shape, NPY_INT, 
-            (self->ptrObj)->getActData());
+    auto dimensions = (self->ptrObj)->getDimensions();
+    npy_intp shape[] = {dimensions.z, dimensions.y, dimensions.x};
+    npy_intp strides[3];
+    for (int i = 0; i < 3; i++)
+        strides[i] = (self->ptrObj)->getStride(2 - i) * sizeof(int);
+    PyObject*  arr = PyArray_New(&PyArray_Type, 3, shape, NPY_INT, strides,
+            (self->ptrObj)->getActData(), 0, NPY_ARRAY_ALIGNED | NPY_ARRAY_WRITEABLE,
+            NULL);
     return arr;
 }
 
@@ -465,7 +1358,6 @@ static PyObject * PyCpm2d_overwriteCell(PyCpm2d* self, PyObject* args)
     
     (self->ptrObj)->addCell(type);
 
-    int dimension = (self->ptrObj)->getDimension();
     for (int i = 0; i < nrOfPoints; i++) {
        
         int x = *static_cast<unsigned int*>(PyArray_GETPTR2(arg, i, 0));
@@ -489,7 +1381,6 @@ static PyObject * PyCpm3d_overwriteCell(PyCpm3d* self, PyObject* args)
     
     (self->ptrObj)->addCell(type);
 
-    int dimension = (self->ptrObj)->getDimension();
     for (int i = 0; i < nrOfPoints; i++) {
         int x = *static_cast<unsigned int*>(PyArray_GETPTR2(arg, i, 0));
         int y = *static_cast<unsigned int*>(PyArray_GETPTR2(arg, i, 1));
@@ -508,11 +1399,16 @@ static PyObject * PyCpm2d_initializeFromArray(PyCpm2d* self, PyObject* args)
     if (!PyArg_ParseTuple(args, "Oi", &arg, &count)) return NULL;
     int dims = PyArray_NDIM(arg);
     npy_intp* dim_vals = PyArray_DIMS(arg);
+    auto dimensions = (self->ptrObj)->getDimensions();
+    if (dims != 2 || dim_vals[0] != dimensions.y || 
+            dim_vals[1] != dimensions.x) {
+        PyErr_SetString(PyExc_ValueError, 
+                "array shape must match the lattice, as (y, x)");
+        return NULL;
+    }
     int x = dim_vals[0];
     int y = dim_vals[1];
 
-    int dimension = (self->ptrObj)->getDimension();
-
     for (int i = 0; i < x; i++) {
         for (int j = 0; j < y; j++) {
             unsigned int cellId = *static_cast<unsigned int*>(PyArray_GETPTR2(arg, i, j));
@@ -536,12 +1432,17 @@ static PyObject * PyCpm3d_initializeFromArray(PyCpm3d* self, PyObject* args)
     if (!PyArg_ParseTuple(args, "Oi", &arg, &count)) return NULL;
     int dims = PyArray_NDIM(arg);
     npy_intp* dim_vals = PyArray_DIMS(arg);
+    auto dimensions = (self->ptrObj)->getDimensions();
+    if (dims != 3 || dim_vals[0] != dimensions.z || 
+            dim_vals[1] != dimensions.y || dim_vals[2] != dimensions.x) {
+        PyErr_SetString(PyExc_ValueError, 
+                "array shape must match the lattice, as (z, y, x)");
+        return NULL;
+    }
     int x = dim_vals[0];
     int y = dim_vals[1];
     int z = dim_vals[2];
 
-    int dimension = (self->ptrObj)->getDimension();
-
 
     for (int i = 0; i < x; i++) {
         for (int j = 0; j < y; j++) {
@@ -566,15 +1467,29 @@ static PyMethodDef PyCpm2d_methods[] = {
     { "add_cell", (PyCFunction)PyCpm2d_addCell, METH_VARARGS, "add new cell at location" },
     { "overwrite_cell", (PyCFunction)PyCpm2d_overwriteCell, METH_VARARGS, "add new cell at location" },
     { "set_point", (PyCFunction)PyCpm2d_setPoint, METH_VARARGS, "set point on lattice for cell that already exists" },
-    { "run", (PyCFunction)PyCpm2d_run, METH_VARARGS, "run for certain number of ticks" },
-    { "run_async", (PyCFunction)PyCpm2d_runAsync, METH_VARARGS, "run for certain number of ticks in seperate thread" },
+    { "run", (PyCFunction)PyCpm2d_run, METH_VARARGS | METH_KEYWORDS, "run for certain number of ticks, optionally on several threads" },
+    { "run_async", (PyCFunction)PyCpm2d_runAsync, METH_VARARGS | METH_KEYWORDS, "run for certain number of ticks in seperate thread" },
     { "join", (PyCFunction)PyCpm2d_join, METH_VARARGS, "join if simulation is running asynchronously" },
+    { "get_seed", (PyCFunction)PyCpm2d_getSeed, METH_VARARGS, "get the seed the simulation was created with" },
+    { "set_acceptance", (PyCFunction)PyCpm2d_setAcceptance, METH_VARARGS | METH_KEYWORDS, "accept copies by exact Boltzmann factors or by log thresholds, with a table for integral energy deltas" },
+    { "set_adhesion_cache", (PyCFunction)PyCpm2d_setAdhesionCache, METH_VARARGS, "keep neighbour type counts of every voxel to compute adhesion from" },
+    { "get_engine_stats", (PyCFunction)PyCpm2d_getEngineStats, METH_VARARGS, "get attempt, acceptance and conflict counts of the last run" },
     { "get_state", (PyCFunction)PyCpm2d_getState, METH_VARARGS, "get state of CPM lattice" },
+    { "get_cell_types", (PyCFunction)PyCpm2d_getCellTypes, METH_VARARGS, "get the type of every cell, indexed by cell id" },
     { "get_field", (PyCFunction)PyCpm2d_getField, METH_VARARGS, "get chemotaxis field of CPM" },
+    { "set_field", (PyCFunction)PyCpm2d_setField, METH_VARARGS, "set chemotaxis field of CPM" },
+    { "set_field_storage", (PyCFunction)PyCpm2d_setFieldStorage, METH_VARARGS | METH_KEYWORDS, "store chemotaxis field as float64, float32, float16, coarse or analytic" },
+    { "add_field_source", (PyCFunction)PyCpm2d_addFieldSource, METH_VARARGS | METH_KEYWORDS, "add point or line source to analytic chemotaxis field" },
+    { "clear_field_sources", (PyCFunction)PyCpm2d_clearFieldSources, METH_VARARGS, "remove all sources of analytic chemotaxis field" },
+    { "set_chemokine", (PyCFunction)PyCpm2d_setChemokine, METH_VARARGS | METH_KEYWORDS, "solve chemokine diffusion and decay during runs and follow its gradient" },
+    { "get_concentration", (PyCFunction)PyCpm2d_getConcentration, METH_VARARGS, "get chemokine concentration" },
     { "get_act_state", (PyCFunction)PyCpm2d_getActState, METH_VARARGS, "get state of CPM act lattice" },
     { "get_centroids", (PyCFunction)PyCpm2d_getCentroids, METH_VARARGS, "get centroids of cells" },
     { "set_constraints", (PyCFunction)PyCpm2d_setConstraints, METH_VARARGS | METH_KEYWORDS, "get state of CPM lattice" },
-    { "update_type", (PyCFunction)PyCpm2d_updateType, METH_VARARGS, "get state of CPM lattice" },
+    { "update_type", (PyCFunction)PyCpm2d_updateType, METH_VARARGS, "switch the type of a cell and all of its voxels" },
+    { "divide_cell", (PyCFunction)PyCpm2d_divideCell, METH_VARARGS | METH_KEYWORDS, "split a cell through its centroid across its major or minor axis or a random direction, returning the new cell id or 0" },
+    { "kill_cell", (PyCFunction)PyCpm2d_killCell, METH_VARARGS | METH_KEYWORDS, "turn a cell into medium, optionally letting the next new cell take its id" },
+    { "divide_cells", (PyCFunction)PyCpm2d_divideCells, METH_VARARGS | METH_KEYWORDS, "divide several cells, finding the splits on several threads, returning the new cell ids" },
     {NULL}  /* Sentinel */
 };
 
@@ -583,15 +1498,29 @@ static PyMethodDef PyCpm3d_methods[] = {
     { "add_cell", (PyCFunction)PyCpm3d_addCell, METH_VARARGS, "add new cell at location" },
     { "overwrite_cell", (PyCFunction)PyCpm3d_overwriteCell, METH_VARARGS, "add new cell at location" },
     { "set_point", (PyCFunction)PyCpm3d_setPoint, METH_VARARGS, "set point on lattice for cell that already exists" },
-    { "run", (PyCFunction)PyCpm3d_run, METH_VARARGS, "run for certain number of ticks" },
-    { "run_async", (PyCFunction)PyCpm3d_runAsync, METH_VARARGS, "run for certain number of ticks in seperate thread" },
+    { "run", (PyCFunction)PyCpm3d_run, METH_VARARGS | METH_KEYWORDS, "run for certain number of ticks, optionally on several threads" },
+    { "run_async", (PyCFunction)PyCpm3d_runAsync, METH_VARARGS | METH_KEYWORDS, "run for certain number of ticks in seperate thread" },
     { "join", (PyCFunction)PyCpm3d_join, METH_VARARGS, "join if simulation is running asynchronously" },
+    { "get_seed", (PyCFunction)PyCpm3d_getSeed, METH_VARARGS, "get the seed the simulation was created with" },
+    { "set_acceptance", (PyCFunction)PyCpm3d_setAcceptance, METH_VARARGS | METH_KEYWORDS, "accept copies by exact Boltzmann factors or by log thresholds, with a table for integral energy deltas" },
+    { "set_adhesion_cache", (PyCFunction)PyCpm3d_setAdhesionCache, METH_VARARGS, "keep neighbour type counts of every voxel to compute adhesion from" },
+    { "get_engine_stats", (PyCFunction)PyCpm3d_getEngineStats, METH_VARARGS, "get attempt, acceptance and conflict counts of the last run" },
     { "get_state", (PyCFunction)PyCpm3d_getState, METH_VARARGS, "get state of CPM lattice" },
+    { "get_cell_types", (PyCFunction)PyCpm3d_getCellTypes, METH_VARARGS, "get the type of every cell, indexed by cell id" },
     { "get_field", (PyCFunction)PyCpm3d_getField, METH_VARARGS, "get chemotaxis field of CPM" },
+    { "set_field", (PyCFunction)PyCpm3d_setField, METH_VARARGS, "set chemotaxis field of CPM" },
+    { "set_field_storage", (PyCFunction)PyCpm3d_setFieldStorage, METH_VARARGS | METH_KEYWORDS, "store chemotaxis field as float64, float32, float16, coarse or analytic" },
+    { "add_field_source", (PyCFunction)PyCpm3d_addFieldSource, METH_VARARGS | METH_KEYWORDS, "add point or line source to analytic chemotaxis field" },
+    { "clear_field_sources", (PyCFunction)PyCpm3d_clearFieldSources, METH_VARARGS, "remove all sources of analytic chemotaxis field" },
+    { "set_chemokine", (PyCFunction)PyCpm3d_setChemokine, METH_VARARGS | METH_KEYWORDS, "solve chemokine diffusion and decay during runs and follow its gradient" },
+    { "get_concentration", (PyCFunction)PyCpm3d_getConcentration, METH_VARARGS, "get chemokine concentration" },
     { "get_act_state", (PyCFunction)PyCpm3d_getActState, METH_VARARGS, "get state of CPM act lattice" },
     { "get_centroids", (PyCFunction)PyCpm3d_getCentroids, METH_VARARGS, "get centroids of cells" },
     { "set_constraints", (PyCFunction)PyCpm3d_setConstraints, METH_VARARGS | METH_KEYWORDS, "get state of CPM lattice" },
-    { "update_type", (PyCFunction)PyCpm3d_updateType, METH_VARARGS, "get state of CPM lattice" },
+    { "update_type", (PyCFunction)PyCpm3d_updateType, METH_VARARGS, "switch the type of a cell and all of its voxels" },
+    { "divide_cell", (PyCFunction)PyCpm3d_divideCell, METH_VARARGS | METH_KEYWORDS, "split a cell through its centroid across its major or minor axis or a random direction, returning the new cell id or 0" },
+    { "kill_cell", (PyCFunction)PyCpm3d_killCell, METH_VARARGS | METH_KEYWORDS, "turn a cell into medium, optionally letting the next new cell take its id" },
+    { "divide_cells", (PyCFunction)PyCpm3d_divideCells, METH_VARARGS | METH_KEYWORDS, "divide several cells, finding the splits on several threads, returning the new cell ids" },
     {NULL}  /* Sentinel */
 };
 
@@ -0,0 +1,60 @@
+#include "rate_tree.h"
+
+using namespace std;
+
+RateTree::RateTree(): _nodes(2, 0.0), _capacity(1) {
+}
+
+void RateTree::grow(int slots) {
+    int capacity = _capacity;
+    while (capacity < slots)
+        capacity *= 2;
+    vector<double> nodes(2 * capacity, 0.0);
+    for (int i = 0; i < _capacity; i++)
+        nodes[capacity + i] = _nodes[_capacity + i];
+    for (int i = capacity - 1; i >= 1; i--)
+        nodes[i] = nodes[2 * i] + nodes[2 * i + 1];
+    _nodes.swap(nodes);
+    _capacity = capacity;
+}
+
+void RateTree::set(int slot, double rate) {
+    if (slot >= _capacity)
+        grow(slot + 1);
+    int i = _capacity + slot;
+    _nodes[i] = rate;
+    for (i /= 2; i >= 1; i /= 2)
+        _nodes[i] = _nodes[2 * i] + _nodes[2 * i + 1];
+}
+
+double RateTree::get(int slot) {
+    if (slot >= _capacity)
+        return 0;
+    return _nodes[_capacity + slot];
+}
+
+double RateTree::total() {
+    return _nodes[1];
+}
+
+// Returns the slot whose cumulative range contains value, for value in
+// [0, total()). Never steps into an empty subtree, even when rounding
+// pushes value past the end of the left one.
+int RateTree::find(double value) {
+    int i = 1;
+    while (i < _capacity) {
+        int left = 2 * i;
+        if (value < _nodes[left] || _nodes[left + 1] <= 0) {
+            i = left;
+        } else {
+            value -= _nodes[left];
+            i = left + 1;
+        }
+    }
+    return i - _capacity;
+}
+
+void RateTree::clear() {
+    _nodes.assign(2, 0.0);
+    _capacity = 1;
+}
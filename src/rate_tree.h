@@ -0,0 +1,24 @@
+#ifndef RATE_TREE_H_
+#define RATE_TREE_H_
+
+#include <vector>
+
+// Binary sum tree over slots with non-negative rates. Setting a rate and
+// drawing a slot proportional to its rate both take O(log n). Inner nodes
+// are recomputed from their children on every update instead of adjusted
+// by differences, so rounding errors do not build up over long runs.
+class RateTree {
+    public:
+        RateTree();
+        void set(int slot, double rate);
+        double get(int slot);
+        double total();
+        int find(double value);
+        void clear();
+    private:
+        void grow(int slots);
+        std::vector<double> _nodes;
+        int _capacity;
+};
+
+#endif // RATE_TREE_H_
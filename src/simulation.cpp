@@ -1,28 +1,67 @@
 #include <random>
 #include <iostream>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <algorithm>
+#include <cmath>
 #include "simulation.h"
+#include "thread_pool.h"
 #include "lattice.h"
 #include "hamiltonian.h"
 #include "cell_states.h"
 #include "centroids.h"
+#include "chemokine_field.h"
 
 using namespace std;
 
 
-class ChemokineField {
-};
+unsigned long long randomSeed() {
+    random_device rd;
+    return ((unsigned long long)rd() << 32) | rd();
+}
+
+// Expands the 64-bit seed into the 32 bytes ranxoshi256 wants with
+// splitmix64, the expansion recommended by the xoshiro authors.
+static void seedXoshi(ranxoshi256* rng, uint64_t seed) {
+    unsigned char bytes[32];
+    uint64_t state = seed;
+    for (int i = 0; i < 4; i++) {
+        uint64_t z = (state += 0x9E3779B97F4A7C15);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+        z = z ^ (z >> 31);
+        for (int b = 0; b < 8; b++)
+            bytes[i * 8 + b] = z >> (56 - 8 * b);
+    }
+    ranxoshi256Seed(rng, bytes);
+}
+
+// Thresholds come in batches of this many.
+static const size_t thresholdBatch = 1024;
 
 template <typename L>
 Simulation<L>::Simulation(L& lattice, Hamiltonian<L>& hamiltonian, 
-        CellStates<L>& cellStates, Centroids<L>& centroids, ChemokineField* field): 
-    _lattice(lattice), _hamiltonian(hamiltonian), _cellStates(cellStates), 
-    _centroids(centroids), _field(field) {
-    random_device rd;
+        CellStates<L>& cellStates, Centroids<L>& centroids, ChemokineField* field,
+        unsigned long long seed): 
+    _lattice(lattice), _hamiltonian(hamiltonian), 
+    _energyKernel(hamiltonian.getEnergyKernel()), 
+    _acceptanceKernel(hamiltonian.getAcceptanceKernel()), 
+    _cellStates(cellStates), 
+    _centroids(centroids), _field(field), _seed(seed), 
+    _acceptance(Acceptance::exact), _nextThreshold(0), _pool(nullptr), 
+    _blockSize(0), _stats(), _waitingCommits(0), _tileSize(0), 
+    _rateSites(lattice.indexCount()), 
+    _ratesValid(false) {
     _time = 0;
-    unsigned int seed[8];
-    for (int i = 0; i < 8; i++)
-        seed[i] = rd();
-    ranxoshi256Seed(&xoshi, (unsigned char*)&seed);
+    seedXoshi(&xoshi, seed);
+    seedXoshi(&_thresholdRng, ~seed);
+}
+
+template <typename L>
+Simulation<L>::~Simulation() {
+    delete _pool;
 }
 
 template <typename L>
@@ -42,79 +81,559 @@ void Simulation<L>::monteCarloStep() {
             source.cellId = 0;
         }
         if (source.cellId != target.cellId && 
-                !_hamiltonian.getFixedCelltype(target.type)
+                !_hamiltonian.getFixedCelltype(target.type) &&
+                _lattice.contains(target)
 
                 ) {
             attempts ++;
             succesful += copyAttempt(source, target);
         }
     }
+    _stats.attempts += attempts;
+    _stats.accepted += succesful;
     _centroids.addCheckpoint();
     _centroids.updatePreferentialDirection();
     //cout << "attempts: " << attempts << " succesful attempts this MCS: " << succesful << endl;
 }
 
+// Same-coloured blocks have a whole block between them. A copy attempt
+// writes at most one voxel away from its source and reads at most two
+// voxels away (the neighbours of the target), so blocks of four or more
+// voxels can be swept concurrently without seeing each other.
 template <typename L>
-void Simulation<L>::stratifiedMonteCarloStep(int* indices) {
-    /*_time += 1;
-    int succesful = 0;
-    int attempts = 0;
+int Simulation<L>::chooseBlockSize() {
+    for (int blockSize = 16; blockSize >= 4; blockSize /= 2) {
+        if (_lattice.fitsBlocks(blockSize))
+            return blockSize;
+    }
+    return 0;
+}
 
-    const int offsets[4][2] = {{0,0}, {0,1}, {1,0}, {1,1}};
-
-    //for (int k = 0; k < 2; k++) {
-        //for (int l = 0; l < 2; l++) {
-        for (int w = 0; w < 4; w++) {
-            int k = offsets[indices[w]][0];
-            int l = offsets[indices[w]][1];
-            for (int i = 0; i < _lattice._dimension/4; i++) {
-                for (int j = 0; j < _lattice._dimension/4; j++) {
-                    //for (int a = 0; a < 2; a++) {
-                        //for (int b = 0; b < 2; b++) {
-                    for (int q = 0; q < 4; q++) {
-                        int a = ranxoshi256Next(&xoshi) % 2;
-                        int b = ranxoshi256Next(&xoshi) % 2;
-
-
-                        auto source = _lattice.getPoint(i * 4 + a + k * 2,j * 4 + b + l * 2);
-                        auto target = _lattice.getRandomNeighbor(source, xoshi);
-                        if (source.cellId != target.cellId) {
-                            attempts ++;
-                            succesful += copyAttempt(source, target);
-                        }
-                    }
-                }
+template <typename L>
+void Simulation<L>::setThreads(int threads) {
+    threads = max(threads, 1);
+    if (_pool && _pool->size() == threads)
+        return;
+    delete _pool;
+    _pool = nullptr;
+    _workerRngs.clear();
+    _blocks.clear();
+    _tileVersions.clear();
+
+    _pool = new ThreadPool(threads);
+    _blockSize = chooseBlockSize();
+    if (_blockSize > 0)
+        _blocks.resize(_lattice.blockCount(_blockSize));
+    _tileSize = _lattice.fitsBlocks(8) ? 8 : 
+        (_lattice.fitsBlocks(4) ? 4 : 0);
+    if (_tileSize > 0)
+        _tileVersions.resize(_lattice.blockCount(_tileSize));
+    _workerRngs.resize(_pool->size());
+}
 
+template <typename L>
+void Simulation<L>::stratifiedMonteCarloStep() {
+    if (!_pool || _blockSize == 0) {
+        monteCarloStep();
+        return;
+    }
+    _time += 1;
 
-                        //}
-                    //}
-                }
+    int colorCount = _lattice.blockColorCount();
+    vector<int> colors;
+    for (int c = 0; c < colorCount; c++)
+        colors.push_back(c);
+    for (int c = colorCount - 1; c > 0; c--) {
+        int r = ranxoshi256Next(&xoshi) % (c + 1);
+        swap(colors[c], colors[r]);
+    }
+
+    vector<int> active;
+    for (int phase = 0; phase < colorCount; phase++) {
+        int color = colors[phase];
+        active.clear();
+        for (int i = 0; i < _lattice._borderIndices.size(); i++) {
+            int site = _lattice._borderIndices.get(i);
+            int block = _lattice.blockOf(site, _blockSize);
+            if (_lattice.blockColor(block, _blockSize) != color)
+                continue;
+            if (_blocks[block].sites.empty())
+                active.push_back(block);
+            _blocks[block].sites.push_back(site);
+        }
+
+        atomic<int> next(0);
+        _pool->run([&](int) {
+            int i;
+            while ((i = next.fetch_add(1)) < (int)active.size()) {
+                sweepBlock(active[i], phase);
             }
-        //}
-    //}
+        });
 
+        for (auto b: active) {
+            auto& block = _blocks[b];
+            _cellStates.commitPending(block.pending);
+            for (auto& copy: block.copies) {
+                _lattice.finishCopy(copy.first, copy.second);
+                _centroids.update(copy.first, copy.second);
+                _hamiltonian.onAccept(copy.first, copy.second);
+            }
+            _stats.attempts += block.attempts;
+            _stats.accepted += block.accepted;
+            block.attempts = 0;
+            block.accepted = 0;
+            block.copies.clear();
+            block.sites.clear();
+        }
+    }
+    _centroids.addCheckpoint();
+    _centroids.updatePreferentialDirection();
+}
 
+// Runs as many copy attempts in the block as it had border sites at the
+// start of the phase. Sites that turned into border sites during the phase
+// are picked up by the next one. Random numbers come from a Philox stream
+// named after the step, phase and block, so the outcome does not depend on
+// which worker sweeps the block or how many workers there are.
+template <typename L>
+void Simulation<L>::sweepBlock(int b, int phase) {
+    auto& block = _blocks[b];
+    philox4x32 rng;
+    philox4x32Seed(&rng, _seed, _time, phase, b);
+    _cellStates.setPending(&block.pending);
+    int attempts = block.sites.size();
+    for (int a = 0; a < attempts; a++) {
+        int site = block.sites[philox4x32Next(&rng) % block.sites.size()];
+        auto source = _lattice.getPoint(site);
+        auto target = _lattice.getNeighbor(source, 
+                philox4x32Next(&rng) % _lattice.getNeighborCount());
+        if(_hamiltonian.getFixedCelltype(source.type)) {
+            source.type = 0;
+            source.cellId = 0;
+        }
+        if (source.cellId == target.cellId || 
+                _hamiltonian.getFixedCelltype(target.type) ||
+                !_lattice.contains(target))
+            continue;
+        block.attempts++;
+        Neighborhood neighbors;
+        _lattice.getNeighborhood(target, neighbors);
+        if (acceptCopy(source, target, neighbors, rng)) {
+            _lattice.copyValues(source, target, _time);
+            _cellStates.updateAreas(source, target);
+            _cellStates.updatePerimeters(source, target, neighbors);
+            block.copies.push_back({source, target});
+            block.accepted++;
+        }
+    }
+    _cellStates.setPending(nullptr);
+}
 
-    //cout << "attempts: " << attempts << " succesful attempts this MCS: " << succesful << endl;
-    */
+// Phase key of the speculative engine's Philox streams, which no phase of
+// the checkerboard engine takes.
+static const uint32_t speculativePhase = 0xFFFFFFFF;
+
+// Lets every worker draw border sites and evaluate copies at the same time,
+// under a shared lock, while commits take it exclusively. Each evaluation
+// remembers the versions of the tiles within two voxels of its target,
+// which covers everything the Hamiltonian reads on the lattice, and of the
+// source and target cells, whose totals and centroids it reads. A commit
+// only goes through if none of those were written in the meantime. Worker
+// streams are seeded from the step and the worker, as the checkerboard
+// engine's are, so that rebuilding the pool does not replay them.
+template <typename L>
+void Simulation<L>::speculativeMonteCarloStep() {
+    if (!_pool || _tileSize == 0) {
+        monteCarloStep();
+        return;
+    }
+    _time += 1;
+
+    for (int worker = 0; worker < (int)_workerRngs.size(); worker++) {
+        philox4x32 philox;
+        philox4x32Seed(&philox, _seed, _time, speculativePhase, worker);
+        seedXoshi(&_workerRngs[worker], philox4x32Next(&philox));
+    }
+    _cellVersions.assign(_lattice.getCellTypes().size(), 0);
+
+    atomic<int> remaining(_lattice._borderIndices.size());
+    vector<EngineStats> stats(_pool->size(), EngineStats());
+    _pool->run([&](int worker) {
+        speculate(_workerRngs[worker], remaining, stats[worker]);
+    });
+    for (auto& s: stats) {
+        _stats.attempts += s.attempts;
+        _stats.accepted += s.accepted;
+        _stats.conflicts += s.conflicts;
+    }
+
+    _centroids.addCheckpoint();
+    _centroids.updatePreferentialDirection();
 }
 
+template <typename L>
+void Simulation<L>::speculate(ranxoshi256& rng, atomic<int>& remaining,
+        EngineStats& stats) {
+    int tiles[8];
+    unsigned int versions[8];
+    while (remaining.fetch_sub(1) > 0) {
+        LatticePoint source;
+        LatticePoint target;
+        int sourceIndex = -1;
+        int targetIndex = -1;
+        bool first = true;
+        double random = 0;
+        while (true) {
+            int tileCount;
+            unsigned int sourceVersion;
+            unsigned int targetVersion;
+            Neighborhood neighbors;
+            double energyDelta;
+            {
+                // Commits waiting for the lock go first, so that a steady
+                // stream of evaluations cannot hold them off.
+                while (_waitingCommits.load() > 0)
+                    this_thread::yield();
+                shared_lock<shared_mutex> lock(_commitMutex);
+                if (first) {
+                    if (_lattice._borderIndices.size() == 0)
+                        return;
+                    source = _lattice.getRandomBorderLocation(rng);
+                    target = _lattice.getRandomNeighbor(source, rng);
+                    sourceIndex = _lattice.index(source);
+                    targetIndex = _lattice.index(target);
+                } else {
+                    source = _lattice.getPoint(sourceIndex);
+                    target = _lattice.getPoint(targetIndex);
+                }
 
+                if(_hamiltonian.getFixedCelltype(source.type)) {
+                    source.type = 0;
+                    source.cellId = 0;
+                }
+                if (source.cellId == target.cellId || 
+                        _hamiltonian.getFixedCelltype(target.type) ||
+                        !_lattice.contains(target))
+                    break;
+                if (first) {
+                    stats.attempts++;
+                    random = ranxoshi256DoubleCO(&rng);
+                    first = false;
+                }
+
+                tileCount = _lattice.blocksAround(target, 2, _tileSize, tiles);
+                for (int i = 0; i < tileCount; i++)
+                    versions[i] = _tileVersions[tiles[i]];
+                sourceVersion = _cellVersions[source.cellId];
+                targetVersion = _cellVersions[target.cellId];
+                _lattice.getNeighborhood(target, neighbors);
+                energyDelta = (_hamiltonian.*_energyKernel)(source, target, 
+                        neighbors, _lattice, _cellStates, _centroids, _time);
+            }
+            if (energyDelta >= 0 && 
+                    _hamiltonian.boltzmannProbability(energyDelta) <= random)
+                break;
 
+            _waitingCommits++;
+            unique_lock<shared_mutex> lock(_commitMutex);
+            _waitingCommits--;
+            bool valid = sourceVersion == _cellVersions[source.cellId] &&
+                targetVersion == _cellVersions[target.cellId];
+            for (int i = 0; i < tileCount; i++)
+                valid = valid && versions[i] == _tileVersions[tiles[i]];
+            if (!valid) {
+                stats.conflicts++;
+                continue;
+            }
+            _lattice.copy(source, target, _time);
+            _cellStates.updateAreas(source, target);
+            _cellStates.updatePerimeters(source, target, neighbors);
+            _centroids.update(source, target);
+            _hamiltonian.onAccept(source, target);
+            _tileVersions[_lattice.blockOf(targetIndex, _tileSize)]++;
+            // The medium has no totals, so copies to and from it need not
+            // wait for each other.
+            if (source.cellId != 0)
+                _cellVersions[source.cellId]++;
+            if (target.cellId != 0)
+                _cellVersions[target.cellId]++;
+            stats.accepted++;
+            break;
+        }
+    }
+}
 
+// n-fold way (Bortz, Kalos and Lebowitz) version of the Metropolis step.
+// Every candidate copy gets the rate at which the Metropolis step would
+// perform it: the acceptance probability divided by the number of
+// neighbours, per Monte Carlo step. Copies are then drawn proportional to
+// their rates with exponentially distributed waiting times, so no time is
+// spent on rejected attempts.
+//
+// A copy changes the energy of every candidate whose source lies within
+// two voxels of its target. When the two cells involved have area or
+// perimeter constraints, it also changes every candidate into or out of
+// those cells. Both groups are recomputed after each copy, which keeps all
+// rates exact. Act and persistence energies change with time itself, so
+// when those are enabled all rates are rebuilt every step, as they are
+// after every update of a chemokine. The engine
+// pays off when few copies are accepted per step, i.e. at low temperature
+// and with weak or no cell-level constraints.
 template <typename L>
-int Simulation<L>::copyAttempt(LatticePoint& source, LatticePoint& target) {
+void Simulation<L>::rejectionFreeMonteCarloStep() {
+    _time += 1;
+    if (!_ratesValid || _hamiltonian.getTimeDependent())
+        rebuildRates();
+
+    const int neighbors = _lattice.getNeighborCount();
+    double elapsed = 0;
+    while (_rateTree.total() > 0) {
+        double total = _rateTree.total();
+        elapsed -= log(1.0 - ranxoshi256DoubleCO(&xoshi)) / total;
+        if (elapsed >= 1)
+            break;
+
+        int slot = _rateTree.find(ranxoshi256DoubleCO(&xoshi) * total);
+        double* rates = &_rates[slot * neighbors];
+        double r = ranxoshi256DoubleCO(&xoshi) * _rateTree.get(slot);
+        int direction = 0;
+        while (direction < neighbors - 1 && 
+                (r >= rates[direction] || rates[direction] <= 0)) {
+            r -= rates[direction];
+            direction++;
+        }
+
+        auto source = _lattice.getPoint(_rateSites.get(slot));
+        auto target = _lattice.getNeighbor(source, direction);
+        if(_hamiltonian.getFixedCelltype(source.type)) {
+            source.type = 0;
+            source.cellId = 0;
+        }
+        _lattice.copy(source, target, _time);
+        _cellStates.updateAreas(source, target);
+        _cellStates.updatePerimeters(source, target, _lattice);
+        _centroids.update(source, target);
+        _hamiltonian.onAccept(source, target);
+        _stats.attempts++;
+        _stats.accepted++;
+
+        _refreshSites.clear();
+        _lattice.sitesAround(target, 2, _nearbySites);
+        _refreshSites.insert(_nearbySites.begin(), _nearbySites.end());
+        if (_hamiltonian.getCellTotalsUsed(source.type))
+            refreshCellRates(source.cellId);
+        if (_hamiltonian.getCellTotalsUsed(target.type))
+            refreshCellRates(target.cellId);
+        for (auto site: _refreshSites)
+            refreshRates(site);
+    }
+
+    _centroids.addCheckpoint();
+    _centroids.updatePreferentialDirection();
+}
+
+template <typename L>
+double Simulation<L>::copyRate(LatticePoint source, LatticePoint target) {
+    if(_hamiltonian.getFixedCelltype(source.type)) {
+        source.type = 0;
+        source.cellId = 0;
+    }
+    if (source.cellId == target.cellId || 
+            _hamiltonian.getFixedCelltype(target.type) ||
+            !_lattice.contains(target))
+        return 0;
     auto energyDelta = _hamiltonian.energyDelta(source, target, _lattice, 
             _cellStates, _centroids, _field, _time);
-    uniform_real_distribution<double> dist(0, 1);
-    if (energyDelta < 0 || 
-            _hamiltonian.boltzmannProbability(energyDelta) > 
-            ranxoshi256DoubleCO(&xoshi)) {
-        
+    double probability = energyDelta < 0 ? 1.0 : 
+        _hamiltonian.boltzmannProbability(energyDelta);
+    return probability / _lattice.getNeighborCount();
+}
+
+// Recomputes the rates of all copies out of a site and adds it to or drops
+// it from the candidate slots. Dropping a site moves the last slot into
+// its place, as DiceSet does, so the rates and tree entry move along.
+template <typename L>
+void Simulation<L>::refreshRates(int site) {
+    const int neighbors = _lattice.getNeighborCount();
+    auto source = _lattice.getPoint(site);
+    double rates[26];
+    double total = 0;
+    for (int i = 0; i < neighbors; i++) {
+        auto target = _lattice.getNeighbor(source, i);
+        rates[i] = copyRate(source, target);
+        total += rates[i];
+    }
+
+    int slot = _rateSites.position(site);
+    if (total > 0) {
+        if (slot < 0) {
+            slot = _rateSites.size();
+            _rateSites.add(site);
+            _rates.resize((slot + 1) * neighbors);
+            _rateCells.push_back(source.cellId);
+            fileRateSite(source.cellId, site, true);
+        } else if (_rateCells[slot] != (int)source.cellId) {
+            fileRateSite(_rateCells[slot], site, false);
+            fileRateSite(source.cellId, site, true);
+            _rateCells[slot] = source.cellId;
+        }
+        for (int i = 0; i < neighbors; i++)
+            _rates[slot * neighbors + i] = rates[i];
+        _rateTree.set(slot, total);
+    } else if (slot >= 0) {
+        int last = _rateSites.size() - 1;
+        fileRateSite(_rateCells[slot], site, false);
+        _rateSites.remove(site);
+        for (int i = 0; i < neighbors; i++)
+            _rates[slot * neighbors + i] = _rates[last * neighbors + i];
+        _rates.resize(last * neighbors);
+        _rateCells[slot] = _rateCells[last];
+        _rateCells.pop_back();
+        _rateTree.set(slot, _rateTree.get(last));
+        _rateTree.set(last, 0);
+    }
+}
+
+// The medium has no cell-level energy terms, so its sites are not filed.
+template <typename L>
+void Simulation<L>::fileRateSite(int cellId, int site, bool add) {
+    if (cellId == 0)
+        return;
+    if (cellId >= (int)_cellRateSites.size())
+        _cellRateSites.resize(cellId + 1);
+    if (add)
+        _cellRateSites[cellId].add(site);
+    else
+        _cellRateSites[cellId].remove(site);
+}
+
+// Queues every candidate copy that involves the cell: copies out of its
+// own sites, and copies into it, whose sources are the neighbours of its
+// sites.
+template <typename L>
+void Simulation<L>::refreshCellRates(int cellId) {
+    if (cellId == 0 || cellId >= (int)_cellRateSites.size())
+        return;
+    auto& sites = _cellRateSites[cellId];
+    for (int i = 0; i < sites.size(); i++) {
+        auto point = _lattice.getPoint(sites.get(i));
+        _refreshSites.insert(sites.get(i));
+        for (int n = 0; n < _lattice.getNeighborCount(); n++) {
+            auto neighbor = _lattice.getNeighbor(point, n);
+            if (neighbor.cellId != (unsigned int)cellId && 
+                    _lattice.contains(neighbor))
+                _refreshSites.insert(_lattice.index(neighbor));
+        }
+    }
+}
+
+template <typename L>
+void Simulation<L>::rebuildRates() {
+    _rateSites.clear();
+    _rates.clear();
+    _rateCells.clear();
+    _cellRateSites.clear();
+    _rateTree.clear();
+    for (int i = 0; i < _lattice._borderIndices.size(); i++)
+        refreshRates(_lattice._borderIndices.get(i));
+    _ratesValid = true;
+}
+
+template <typename L>
+void Simulation<L>::invalidateRates() {
+    _ratesValid = false;
+}
+
+template <typename L>
+EngineStats Simulation<L>::getStats() {
+    return _stats;
+}
+
+template <typename L>
+void Simulation<L>::resetStats() {
+    _stats = EngineStats();
+}
+
+template <typename L>
+unsigned long long Simulation<L>::getSeed() {
+    return _seed;
+}
+
+// Advances the chemokine on the worker threads once every interval steps.
+template <typename L>
+void Simulation<L>::updateChemokine() {
+    if (!_field || !_field->enabled() || _time % _field->interval() != 0)
+        return;
+    _field->update(_lattice.getCellIds(), _lattice.getCellTypes().data(),
+            _lattice.stride(1), _lattice.stride(2), *_pool);
+    // Chemotaxis follows the new gradient everywhere at once.
+    invalidateRates();
+}
+
+static inline double uniform(ranxoshi256& rng) {
+    return ranxoshi256DoubleCO(&rng);
+}
+
+static inline double uniform(philox4x32& rng) {
+    return philox4x32DoubleCO(&rng);
+}
+
+template <typename L>
+template <typename R>
+bool Simulation<L>::acceptCopy(LatticePoint& source, LatticePoint& target,
+        Neighborhood& neighbors, R& rng) {
+    auto energyDelta = (_hamiltonian.*_energyKernel)(source, target, 
+            neighbors, _lattice, _cellStates, _centroids, _time);
+    return energyDelta < 0 || 
+        _hamiltonian.boltzmannProbability(energyDelta) > uniform(rng);
+}
+
+// Takes the energy kernels for the terms enabled now, so copy attempts call
+// them directly without checking each term. Has to follow
+// Hamiltonian::updateConstraintToggles.
+template <typename L>
+void Simulation<L>::selectKernels() {
+    _energyKernel = _hamiltonian.getEnergyKernel();
+    _acceptanceKernel = _hamiltonian.getAcceptanceKernel();
+}
+
+// Only the serial engine draws thresholds; the others keep comparing
+// Boltzmann factors against their own streams.
+template <typename L>
+void Simulation<L>::setAcceptance(Acceptance acceptance) {
+    _acceptance = acceptance;
+}
+
+// Computing the logarithms a batch at a time keeps them out of the copy
+// attempts, and gives the compiler a plain loop to work on.
+template <typename L>
+double Simulation<L>::nextThreshold() {
+    if (_nextThreshold == _thresholds.size()) {
+        _thresholds.resize(thresholdBatch);
+        for (auto& threshold: _thresholds)
+            threshold = ranxoshi256DoubleCO(&_thresholdRng);
+        const double temperature = _hamiltonian.getTemperature();
+        for (auto& threshold: _thresholds)
+            threshold = -temperature * log(threshold);
+        _nextThreshold = 0;
+    }
+    return _thresholds[_nextThreshold++];
+}
+
+template <typename L>
+int Simulation<L>::copyAttempt(LatticePoint& source, LatticePoint& target) {
+    Neighborhood neighbors;
+    _lattice.getNeighborhood(target, neighbors);
+    bool accepted = _acceptance == Acceptance::threshold ?
+        (_hamiltonian.*_acceptanceKernel)(source, target, neighbors, 
+                _lattice, _cellStates, _centroids, _time, nextThreshold()) :
+        acceptCopy(source, target, neighbors, xoshi);
+    if (accepted) {
         _lattice.copy(source, target, _time);
         _cellStates.updateAreas(source, target);
-        _cellStates.updatePerimeters(source, target, _lattice);
+        _cellStates.updatePerimeters(source, target, neighbors);
         _centroids.update(source, target);
+        _hamiltonian.onAccept(source, target);
         return 1;
     }
     return 0;
@@ -1,32 +1,136 @@
 #ifndef SIMULATION_H_
 #define SIMULATION_H_
 
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
 #include "ranxoshi256.h"
+#include "philox.h"
+#include "cell_states.h"
+#include "dice_set.h"
+#include "paged_dice_set.h"
+#include "rate_tree.h"
+#include "hamiltonian.h"
 
-template <typename L> class Hamiltonian;
-template <typename L> class CellStates;
 template <typename L> class Centroids;
 
 class ChemokineField;
+class ThreadPool;
+
+enum class Engine {
+    automatic,
+    serial,
+    checkerboard,
+    speculative,
+    rejectionFree
+};
+
+// exact accepts an unfavourable copy when its Boltzmann factor exceeds a
+// uniform draw. threshold accepts it when the energy delta is below
+// -temperature * log(u), with the thresholds drawn in batches from a
+// stream of their own, which is the same in distribution. Knowing the
+// threshold up front lets the energy evaluation stop early.
+enum class Acceptance {
+    exact,
+    threshold
+};
+
+unsigned long long randomSeed();
+
+struct EngineStats {
+    long long attempts;
+    long long accepted;
+    long long conflicts;
+};
 
 
 template <typename L>
 class Simulation {
     public:
         typedef typename L::LatticePoint LatticePoint;
-        Simulation(L& lattice, Hamiltonian<L>& hamiltonian, CellStates<L>& cellStates, 
-                 Centroids<L>& centroids, ChemokineField* field);
+        typedef typename L::Neighborhood Neighborhood;
+        Simulation(L& lattice, Hamiltonian<L>& hamiltonian, CellStates<L>& cellStates,
+                 Centroids<L>& centroids, ChemokineField* field, 
+                 unsigned long long seed);
+        ~Simulation();
+        void setThreads(int threads);
+        void setAcceptance(Acceptance acceptance);
+        void selectKernels();
         void monteCarloStep();
-        void stratifiedMonteCarloStep(int* indices);
+        void stratifiedMonteCarloStep();
+        void speculativeMonteCarloStep();
+        void rejectionFreeMonteCarloStep();
+        void invalidateRates();
+        void updateChemokine();
         int copyAttempt(LatticePoint& source, LatticePoint& target);
+        EngineStats getStats();
+        void resetStats();
+        unsigned long long getSeed();
         int _time;
     private:
+        // Work list and results of one block during a stratified sweep.
+        struct Block {
+            std::vector<int> sites;
+            std::vector<std::pair<LatticePoint, LatticePoint>> copies;
+            typename CellStates<L>::Pending pending;
+            int attempts;
+            int accepted;
+        };
+        int chooseBlockSize();
+        void sweepBlock(int block, int phase);
+        void speculate(ranxoshi256& rng, std::atomic<int>& remaining,
+                EngineStats& stats);
+        template <typename R>
+        bool acceptCopy(LatticePoint& source, LatticePoint& target, 
+                Neighborhood& neighbors, R& rng);
+        double nextThreshold();
+        double copyRate(LatticePoint source, LatticePoint target);
+        void refreshRates(int site);
+        void rebuildRates();
+        void refreshCellRates(int cellId);
+        void fileRateSite(int cellId, int site, bool add);
         L& _lattice;
         Hamiltonian<L>& _hamiltonian;
+        typename Hamiltonian<L>::EnergyKernel _energyKernel;
+        typename Hamiltonian<L>::AcceptanceKernel _acceptanceKernel;
         CellStates<L>& _cellStates;
         Centroids<L>& _centroids;
         ChemokineField* _field;
+        unsigned long long _seed;
         ranxoshi256 xoshi;
-}; 
+
+        Acceptance _acceptance;
+        ranxoshi256 _thresholdRng;
+        std::vector<double> _thresholds;
+        size_t _nextThreshold;
+
+        ThreadPool* _pool;
+        std::vector<ranxoshi256> _workerRngs;
+        std::vector<Block> _blocks;
+        int _blockSize;
+        EngineStats _stats;
+
+        std::shared_mutex _commitMutex;
+        std::atomic<int> _waitingCommits;
+        std::vector<unsigned int> _tileVersions;
+        // Bumped on every commit that changes the cell's totals.
+        std::vector<unsigned int> _cellVersions;
+        int _tileSize;
+
+        // Rejection-free engine: border sites with at least one possible
+        // copy, the rate of each of their neighbour copies, and a sum tree
+        // over the per-site totals in the same slot order. The sites are
+        // also filed under the cell occupying them.
+        PagedDiceSet _rateSites;
+        std::vector<double> _rates;
+        std::vector<int> _rateCells;
+        std::vector<DiceSet> _cellRateSites;
+        RateTree _rateTree;
+        std::vector<int> _nearbySites;
+        ska::flat_hash_set<int> _refreshSites;
+        bool _ratesValid;
+};
 
 #endif // SIMULATION_H_
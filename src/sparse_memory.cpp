@@ -0,0 +1,69 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <new>
+#include "sparse_memory.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define SPARSE_MEMORY_MMAP
+#endif
+
+using namespace std;
+
+#ifdef SPARSE_MEMORY_MMAP
+
+// Anonymous mappings are zero-filled on first write. They are not reserved
+// against swap, so a lattice bigger than RAM can be mapped as long as only
+// part of it is used, and huge pages are avoided because a single write
+// would commit a whole one.
+void* allocateSparse(size_t bytes) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+    flags |= MAP_NORESERVE;
+#endif
+    void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (memory == MAP_FAILED)
+        throw bad_alloc();
+#ifdef MADV_NOHUGEPAGE
+    madvise(memory, bytes, MADV_NOHUGEPAGE);
+#endif
+    return memory;
+}
+
+void freeSparse(void* memory, size_t bytes) {
+    munmap(memory, bytes);
+}
+
+// Not every system zeroes pages that were given up, so the range is cleared
+// first. Only the whole pages inside it are handed back.
+void releaseSparse(void* memory, size_t bytes) {
+    static const uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    memset(memory, 0, bytes);
+    uintptr_t begin = ((uintptr_t)memory + pageSize - 1) & ~(pageSize - 1);
+    uintptr_t end = ((uintptr_t)memory + bytes) & ~(pageSize - 1);
+    if (begin < end)
+        madvise((void*)begin, end - begin, MADV_DONTNEED);
+}
+
+#else
+
+// Large callocs are lazily zeroed by most allocators as well, but memory
+// is not returned until the lattice is freed.
+void* allocateSparse(size_t bytes) {
+    void* memory = calloc(bytes, 1);
+    if (memory == nullptr)
+        throw bad_alloc();
+    return memory;
+}
+
+void freeSparse(void* memory, size_t bytes) {
+    free(memory);
+}
+
+void releaseSparse(void* memory, size_t bytes) {
+    memset(memory, 0, bytes);
+}
+
+#endif // SPARSE_MEMORY_MMAP
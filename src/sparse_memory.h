@@ -0,0 +1,14 @@
+#ifndef SPARSE_MEMORY_H_
+#define SPARSE_MEMORY_H_
+
+#include <cstddef>
+
+// Zero-filled memory that is only backed by RAM where it has been written;
+// everything else reads as zeros from one shared page. Used for lattice
+// arrays, which are mostly medium in low-occupancy simulations.
+void* allocateSparse(size_t bytes);
+void freeSparse(void* memory, size_t bytes);
+// Hands the pages inside a range back, after which it reads as zeros again.
+void releaseSparse(void* memory, size_t bytes);
+
+#endif // SPARSE_MEMORY_H_
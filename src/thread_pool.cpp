@@ -0,0 +1,76 @@
+#include "thread_pool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(int threads): _task(nullptr), _generation(0),
+    _running(0), _stop(false) {
+    for (int i = 1; i < threads; i++) {
+        _workers.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stop = true;
+    }
+    _start.notify_all();
+    for (auto& worker: _workers) {
+        worker.join();
+    }
+}
+
+int ThreadPool::size() {
+    return _workers.size() + 1;
+}
+
+void ThreadPool::run(const function<void(int)>& task) {
+    {
+        lock_guard<mutex> lock(_mutex);
+        _task = &task;
+        _running = _workers.size();
+        _generation++;
+    }
+    _start.notify_all();
+
+    task(0);
+
+    unique_lock<mutex> lock(_mutex);
+    _done.wait(lock, [this] { return _running == 0; });
+    _task = nullptr;
+}
+
+// Splits count items into one contiguous range per worker and runs task on
+// each non-empty one.
+void ThreadPool::runRanges(int count, const function<void(int, int)>& task) {
+    int workers = size();
+    run([&](int worker) {
+        int begin = (long long)count * worker / workers;
+        int end = (long long)count * (worker + 1) / workers;
+        if (begin < end)
+            task(begin, end);
+    });
+}
+
+void ThreadPool::work(int worker) {
+    int generation = 0;
+    while (true) {
+        const function<void(int)>* task;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _start.wait(lock, [&] { return _stop || _generation != generation; });
+            if (_stop)
+                return;
+            generation = _generation;
+            task = _task;
+        }
+
+        (*task)(worker);
+
+        {
+            lock_guard<mutex> lock(_mutex);
+            _running--;
+        }
+        _done.notify_one();
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed set of worker threads that all run the same task and then wait at a
+// barrier. The calling thread takes part as worker 0, so a pool of size 1
+// starts no threads at all.
+class ThreadPool {
+    public:
+        ThreadPool(int threads);
+        ~ThreadPool();
+        void run(const std::function<void(int)>& task);
+        void runRanges(int count, 
+                const std::function<void(int, int)>& task);
+        int size();
+    private:
+        void work(int worker);
+        std::vector<std::thread> _workers;
+        std::mutex _mutex;
+        std::condition_variable _start;
+        std::condition_variable _done;
+        const std::function<void(int)>* _task;
+        int _generation;
+        int _running;
+        bool _stop;
+};
+
+#endif // THREAD_POOL_H_
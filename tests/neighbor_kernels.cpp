@@ -0,0 +1,79 @@
+// Checks that every neighbourhood kernel the host supports counts exactly
+// as a plain loop does, on random 2D and 3D neighbourhoods that mix the
+// medium, the source and the target cell. Build and run from the
+// repository root with
+//     g++ -std=c++17 -O2 -Isrc tests/neighbor_kernels.cpp src/neighbor_kernels.cpp && ./a.out
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "neighbor_kernels.h"
+
+using namespace std;
+
+static const int numberOfTypes = 5;
+
+int compare(const NeighborKernels& kernels, int count, mt19937& rng) {
+    int adhesion[numberOfTypes * numberOfTypes];
+    for (int& value: adhesion)
+        value = int(rng() % 200) - 50;
+    int failures = 0;
+    for (int trial = 0; trial < 20000; trial++) {
+        // Few distinct ids, so that the source and the target, either of
+        // which may be the medium, show up often.
+        unsigned int pool[] = {0, unsigned(1 + rng() % 3),
+            unsigned(1 + rng() % 3), unsigned(4 + rng() % 1000)};
+        vector<unsigned int> ids(count);
+        vector<char> types(count);
+        vector<int> typeOf(1005);
+        for (auto& type: typeOf)
+            type = 1 + rng() % (numberOfTypes - 1);
+        typeOf[0] = 0;
+        for (int i = 0; i < count; i++) {
+            ids[i] = pool[rng() % 4];
+            types[i] = typeOf[ids[i]];
+        }
+        unsigned int sourceId = pool[rng() % 4];
+        unsigned int targetId = pool[rng() % 4];
+        const int* sourceColumn = &adhesion[typeOf[sourceId]];
+        const int* targetColumn = &adhesion[typeOf[targetId]];
+
+        int expectedA = 0, expectedB = 0, expectedDelta = 0;
+        for (int i = 0; i < count; i++) {
+            expectedA += ids[i] == sourceId;
+            expectedB += ids[i] == targetId;
+            if (ids[i] != sourceId)
+                expectedDelta += sourceColumn[types[i] * numberOfTypes];
+            if (ids[i] != targetId)
+                expectedDelta -= targetColumn[types[i] * numberOfTypes];
+        }
+
+        int matchesA = -1, matchesB = -1;
+        kernels.countMatches(ids.data(), count, sourceId, targetId,
+                &matchesA, &matchesB);
+        int delta = kernels.adhesionDelta(ids.data(), types.data(), count,
+                sourceId, targetId, sourceColumn, targetColumn,
+                numberOfTypes);
+        if (matchesA != expectedA || matchesB != expectedB ||
+                delta != expectedDelta) {
+            if (failures++ < 5)
+                printf("%s, %d neighbours, source %u, target %u: matches "
+                        "%d %d, adhesion %d, expected %d %d, %d\n",
+                        kernels.name, count, sourceId, targetId, matchesA,
+                        matchesB, delta, expectedA, expectedB,
+                        expectedDelta);
+        }
+    }
+    return failures;
+}
+
+int main() {
+    int failures = 0;
+    for (auto kernels: supportedNeighborKernels()) {
+        mt19937 rng(1);
+        int kernelFailures = compare(*kernels, 8, rng) +
+            compare(*kernels, 26, rng);
+        printf("%s: %s\n", kernels->name, kernelFailures ? "FAILED" : "ok");
+        failures += kernelFailures;
+    }
+    return failures != 0;
+}
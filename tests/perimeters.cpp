@@ -0,0 +1,88 @@
+// Checks that cell perimeters on lattices with walls agree however they
+// are computed: from the grid at start, by recalcPerimeter, and by the
+// incremental updates after copies. Build and run from the repository root
+// with
+//     g++ -std=c++17 -O2 -Isrc tests/perimeters.cpp $(ls src/*.cpp | grep -v python_wrapper) -lpthread && ./a.out
+#include <cstdio>
+#include <random>
+#include "lattice.h"
+#include "cell_states.h"
+
+using namespace std;
+
+// Cells are boxes, the first few pressed against the walls.
+template <typename L>
+int compare(L& lattice, const char* name, int cells) {
+    CellStates<L> states(lattice);
+    states.initializeFromGrid(lattice, cells);
+    int failures = 0;
+    vector<int> initial;
+    for (int id = 1; id <= cells; id++)
+        initial.push_back(states.getPerimeter(id));
+
+    for (int id = 1; id <= cells; id++) {
+        states.recalcPerimeter(lattice, id);
+        if (states.getPerimeter(id) != initial[id-1]) {
+            printf("%s: cell %d starts with perimeter %d, recalcPerimeter "
+                    "gives %d\n", name, id, initial[id-1], 
+                    states.getPerimeter(id));
+            failures++;
+        }
+    }
+
+    mt19937 rng(1);
+    for (int i = 0; i < 20000; i++) {
+        auto target = lattice.getPoint(
+                lattice.voxelIndex(rng() % lattice.size()));
+        auto source = lattice.getNeighbor(target, 
+                rng() % lattice.getNeighborCount());
+        if (source.cellId == target.cellId || !lattice.contains(source))
+            continue;
+        lattice.copy(source, target, 0);
+        states.updateAreas(source, target);
+        states.updatePerimeters(source, target, lattice);
+    }
+    for (int id = 1; id <= cells; id++) {
+        int updated = states.getPerimeter(id);
+        states.recalcPerimeter(lattice, id);
+        if (states.getPerimeter(id) != updated) {
+            printf("%s: cell %d has perimeter %d after copies, "
+                    "recalcPerimeter gives %d\n", name, id, updated,
+                    states.getPerimeter(id));
+            failures++;
+        }
+    }
+    printf("%s: %s\n", name, failures ? "FAILED" : "ok");
+    return failures;
+}
+
+int main() {
+    int failures = 0;
+    {
+        Lattice2d lattice({40, 30}, {Boundary::wall, Boundary::periodic});
+        int boxes[][4] = {{0, 0, 8, 6}, {32, 10, 40, 20}, {10, 25, 20, 30}, 
+            {15, 8, 25, 18}};
+        for (int id = 1; id <= 4; id++) {
+            auto b = boxes[id-1];
+            for (int y = b[1]; y < b[3]; y++)
+                for (int x = b[0]; x < b[2]; x++)
+                    lattice.setPoint(id, x, y, 0, 1);
+        }
+        failures += compare(lattice, "2d", 4);
+    }
+    {
+        Lattice3d lattice({24, 20, 16}, 
+                {Boundary::wall, Boundary::periodic, Boundary::wall});
+        int boxes[][6] = {{0, 0, 0, 6, 6, 6}, {18, 5, 10, 24, 12, 16},
+            {8, 14, 4, 14, 20, 10}};
+        for (int id = 1; id <= 3; id++) {
+            auto b = boxes[id-1];
+            for (int z = b[2]; z < b[5]; z++)
+                for (int y = b[1]; y < b[4]; y++)
+                    for (int x = b[0]; x < b[3]; x++)
+                        lattice.setPoint(id, x, y, z, 0, 1);
+        }
+        failures += compare(lattice, "3d", 3);
+    }
+    return failures ? 1 : 0;
+}